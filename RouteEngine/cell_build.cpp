@@ -0,0 +1,47 @@
+/*
+ Partition a road network text file into cells and write the cell graph
+ that the route server maps.
+
+ Usage: cell_build <road file> <cell file> [max cell vertices] [threads]
+ */
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <exception>
+
+#include "cell_graph.h"
+
+int main(int argc, char **argv) {
+    if (argc < 3) {
+        std::fprintf(stderr, "usage: %s <road file> <cell file> "
+            "[max cell vertices] [threads]\n", argv[0]);
+        return 2;
+    }
+    uint32_t max_cell = argc > 3 ? std::atoi(argv[3]) : 4096;
+    unsigned threads = argc > 4 ? std::atoi(argv[4]) : 0;
+
+    try {
+        RoadMap map;
+        load_road_map(argv[1], map, threads);
+
+        auto start = std::chrono::steady_clock::now();
+        build_cell_graph(map, argv[2], max_cell, threads);
+        double s = std::chrono::duration<double>(
+            std::chrono::steady_clock::now() - start).count();
+
+        CellGraph cells(argv[2]);
+        std::printf("vertices %u\nedges %u\nbuild s %.1f\n",
+            cells.num_vertices(), cells.num_edges(), s);
+        for (uint32_t l = 0; l < cells.num_levels(); l++) {
+            std::printf("level %u: cells %u, boundary vertices %u\n", l,
+                cells.num_cells(l), cells.num_boundary(l));
+        }
+        std::printf("overlay bytes %llu\n",
+            (unsigned long long) cells.overlay_bytes());
+    } catch (const std::exception &e) {
+        std::fprintf(stderr, "%s\n", e.what());
+        return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,1105 @@
+#include "cell_graph.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <functional>
+#include <queue>
+#include <stdexcept>
+#include <string>
+#include <unordered_map>
+
+#include "parallel.h"
+
+/*
+    Building: the vertices are put in cell order by recursive bisection,
+    splitting each range at the median of its longer side until it is
+    small enough, so neighbouring cells hold neighbouring streets.  The
+    bottom cells are the leaves of the bisection and the cells of each
+    level above are its subtrees level_depth steps further up, so they
+    come from the vertex ranges alone.  The boundary vertices of every
+    level and the edges between cells come from one pass over the edges.
+    The overlay distances of a bottom cell come from a Dijkstra per
+    boundary vertex kept inside the cell, and those of a cell higher up
+    from one over the level below kept inside the cell, with the cells of
+    a level done in parallel.
+
+    Searching: a Dijkstra over vertices of the two end cells, with all of
+    their edges, and over boundary vertices elsewhere, with the overlay
+    distances across the highest cell holding neither end and the edges
+    leaving that cell.  Overlay steps in the result are filled in by a
+    search over the level below inside their cell, down to the edges.
+*/
+
+const uint32_t cell_graph_version = 2;
+
+namespace {
+
+// bisection steps between one overlay level and the next
+const uint32_t level_depth = 3;
+
+struct Range {
+    uint32_t begin, end;
+};
+
+typedef std::pair<uint32_t, uint32_t> QueueItem;    // (distance, vertex)
+typedef std::priority_queue<QueueItem, std::vector<QueueItem>,
+    std::greater<QueueItem>> MinQueue;
+
+// cut order into ranges of at most max_vertices, left to right
+std::vector<Range> partition(const RoadMap &map, std::vector<uint32_t> &order,
+        uint32_t max_vertices) {
+    std::vector<Range> cells, stack;
+    stack.push_back({0, (uint32_t) order.size()});
+    while (!stack.empty()) {
+        Range r = stack.back();
+        stack.pop_back();
+        if (r.end - r.begin <= max_vertices) {
+            cells.push_back(r);
+            continue;
+        }
+
+        int32_t min_lat = INT32_MAX, max_lat = INT32_MIN;
+        int32_t min_lon = INT32_MAX, max_lon = INT32_MIN;
+        for (uint32_t i = r.begin; i < r.end; i++) {
+            min_lat = std::min(min_lat, map.lat[order[i]]);
+            max_lat = std::max(max_lat, map.lat[order[i]]);
+            min_lon = std::min(min_lon, map.lon[order[i]]);
+            max_lon = std::max(max_lon, map.lon[order[i]]);
+        }
+        const std::vector<int32_t> &coord =
+            (int64_t) max_lat - min_lat > (int64_t) max_lon - min_lon
+            ? map.lat : map.lon;
+
+        uint32_t mid = r.begin + (r.end - r.begin) / 2;
+        std::nth_element(order.begin() + r.begin, order.begin() + mid,
+            order.begin() + r.end, [&](uint32_t a, uint32_t b) {
+                return coord[a] != coord[b] ? coord[a] < coord[b] : a < b;
+            });
+        // the left half on top, so cells come out in order
+        stack.push_back({mid, r.end});
+        stack.push_back({r.begin, mid});
+    }
+    return cells;
+}
+
+// the number of bisection steps from n vertices down to the deepest leaf
+uint32_t tree_depth(uint32_t n, uint32_t max_vertices) {
+    uint32_t depth = 0;
+    for (; n > max_vertices; n -= n / 2) {
+        depth++;
+    }
+    return depth;
+}
+
+// the ranges of the bisection at depth, or of the leaves above it, in
+// the order partition splits them
+std::vector<Range> subtrees(uint32_t n, uint32_t max_vertices,
+        uint32_t depth) {
+    std::vector<Range> ranges;
+    std::vector<std::pair<Range, uint32_t>> stack;
+    stack.push_back({{0, n}, 0});
+    while (!stack.empty()) {
+        auto [r, d] = stack.back();
+        stack.pop_back();
+        if (r.end - r.begin <= max_vertices || d == depth) {
+            ranges.push_back(r);
+            continue;
+        }
+        uint32_t mid = r.begin + (r.end - r.begin) / 2;
+        stack.push_back({{mid, r.end}, d + 1});
+        stack.push_back({{r.begin, mid}, d + 1});
+    }
+    return ranges;
+}
+
+uint64_t align8(uint64_t offset) {
+    return (offset + 7) / 8 * 8;
+}
+
+// where each array of the overlay starts, in bytes from overlay_offset
+struct OverlayLayout {
+    uint64_t cut_first, cut_head, cut_weight, cut_level;
+    std::vector<uint64_t> cells, boundary_vertex, cliques;
+    uint64_t size;
+};
+
+OverlayLayout overlay_layout(uint32_t num_cut_edges, const LevelInfo *levels,
+        uint32_t num_levels) {
+    OverlayLayout layout;
+    uint64_t at = 0;
+    auto place = [&](uint64_t bytes) {
+        uint64_t start = at;
+        at = align8(at + bytes);
+        return start;
+    };
+    layout.cut_first = place(4 * ((uint64_t) levels[0].num_boundary + 1));
+    layout.cut_head = place(4 * (uint64_t) num_cut_edges);
+    layout.cut_weight = place(4 * (uint64_t) num_cut_edges);
+    layout.cut_level = place(4 * (uint64_t) num_cut_edges);
+    for (uint32_t l = 0; l < num_levels; l++) {
+        layout.cells.push_back(
+            place(sizeof(LevelCell) * (uint64_t) levels[l].num_cells));
+        layout.boundary_vertex.push_back(
+            place(4 * (uint64_t) levels[l].num_boundary));
+        layout.cliques.push_back(place(4 * levels[l].clique_size));
+    }
+    layout.size = at;
+    return layout;
+}
+
+// true if the cells run through vertices 0 .. num_vertices-1 in order,
+// each block the size its counts give and inside the file
+bool cells_valid(const CellInfo *cells, uint32_t num_cells,
+        uint32_t num_vertices, uint64_t file_size) {
+    uint64_t next = 0;
+    for (uint32_t c = 0; c < num_cells; c++) {
+        const CellInfo &cell = cells[c];
+        uint64_t size = 8 * (uint64_t) cell.num_vertices
+            + 4 * (4 * (uint64_t) cell.num_vertices + 1)
+            + 8 * (uint64_t) cell.num_edges;
+        if (cell.first_vertex != next || cell.num_vertices == 0
+                || cell.size != size || cell.offset > file_size
+                || cell.size > file_size - cell.offset) {
+            return false;
+        }
+        next += cell.num_vertices;
+    }
+    return num_cells > 0 && next == num_vertices;
+}
+
+// true if the cells of a level run through vertices 0 .. num_vertices-1
+// in order, each starting where one of the cells below starts, with
+// their boundary vertices ascending inside them and their cliques back
+// to back
+bool level_valid(const LevelInfo &info, const LevelCell *cells,
+        const uint32_t *boundary_vertex, uint32_t num_vertices,
+        const std::vector<uint32_t> &below_starts) {
+    uint64_t next_vertex = 0, next_boundary = 0, next_clique = 0;
+    size_t j = 0;
+    for (uint32_t c = 0; c < info.num_cells; c++) {
+        const LevelCell &cell = cells[c];
+        if (cell.first_vertex != next_vertex || cell.num_vertices == 0
+                || cell.first_boundary != next_boundary
+                || cell.num_boundary > info.num_boundary - next_boundary
+                || cell.clique_offset != next_clique) {
+            return false;
+        }
+        while (j < below_starts.size() && below_starts[j] < cell.first_vertex) {
+            j++;
+        }
+        if (j == below_starts.size() || below_starts[j] != cell.first_vertex) {
+            return false;
+        }
+        const uint32_t *boundary = boundary_vertex + cell.first_boundary;
+        for (uint32_t i = 0; i < cell.num_boundary; i++) {
+            if (boundary[i] < cell.first_vertex
+                    || boundary[i] - cell.first_vertex >= cell.num_vertices
+                    || (i > 0 && boundary[i] <= boundary[i - 1])) {
+                return false;
+            }
+        }
+        next_vertex += cell.num_vertices;
+        next_boundary += cell.num_boundary;
+        next_clique += (uint64_t) cell.num_boundary * cell.num_boundary;
+    }
+    return info.num_cells > 0 && next_vertex == num_vertices
+        && next_boundary == info.num_boundary
+        && next_clique == info.clique_size;
+}
+
+// true if the num_boundary + 1 entries of cut_first never go down and run
+// from 0 to num_cut_edges, and every cut edge ends at a boundary vertex
+// with a level below num_levels, each vertex's by decreasing level
+bool cut_edges_valid(const uint32_t *cut_first, const uint32_t *cut_head,
+        const uint32_t *cut_level, uint32_t num_boundary,
+        uint32_t num_cut_edges, uint32_t num_levels) {
+    if (cut_first[0] != 0 || cut_first[num_boundary] != num_cut_edges) {
+        return false;
+    }
+    for (uint32_t b = 0; b < num_boundary; b++) {
+        if (cut_first[b + 1] < cut_first[b]) {
+            return false;
+        }
+        for (uint32_t k = cut_first[b]; k < cut_first[b + 1]; k++) {
+            if (cut_head[k] >= num_boundary || cut_level[k] >= num_levels
+                    || (k > cut_first[b] && cut_level[k] > cut_level[k - 1])) {
+                return false;
+            }
+        }
+    }
+    return true;
+}
+
+uint64_t page_align(uint64_t offset, uint64_t page_size) {
+    return (offset + page_size - 1) / page_size * page_size;
+}
+
+// sequential writes to the output file, tracking the offset
+struct Writer {
+    FILE *out;
+    const char *path;
+    uint64_t offset = 0;
+
+    Writer(const char *path) : path(path) {
+        out = std::fopen(path, "wb");
+        if (!out) {
+            throw std::runtime_error(std::string("cannot create ") + path);
+        }
+    }
+
+    ~Writer() {
+        if (out) {
+            std::fclose(out);
+        }
+    }
+
+    void write(const void *data, size_t size) {
+        if (size > 0 && std::fwrite(data, 1, size, out) != size) {
+            throw std::runtime_error(std::string("cannot write ") + path);
+        }
+        offset += size;
+    }
+
+    template <typename T>
+    void write(const std::vector<T> &v) {
+        write(v.data(), v.size() * sizeof(T));
+    }
+
+    // zero fill up to offset to
+    void pad_to(uint64_t to) {
+        static const char zeros[4096] = {0};
+        while (offset < to) {
+            write(zeros, std::min<uint64_t>(sizeof(zeros), to - offset));
+        }
+    }
+
+    void close() {
+        FILE *f = out;
+        out = nullptr;
+        if (std::fclose(f) != 0) {
+            throw std::runtime_error(std::string("cannot write ") + path);
+        }
+    }
+};
+
+} // namespace
+
+void build_cell_graph(const RoadMap &map, const char *out_path,
+        uint32_t max_cell_vertices, unsigned num_threads) {
+    num_threads = default_threads(num_threads);
+    uint32_t n = map.num_vertices();
+    uint64_t page_size = sysconf(_SC_PAGESIZE);
+    uint32_t max_vertices = std::max<uint32_t>(1, max_cell_vertices);
+
+    // order[new] is the map vertex numbered new, renumber[old] the reverse
+    std::vector<uint32_t> order(n);
+    for (uint32_t v = 0; v < n; v++) {
+        order[v] = v;
+    }
+    std::vector<std::vector<Range>> level_ranges;
+    level_ranges.push_back(partition(map, order, max_vertices));
+    for (uint32_t depth = tree_depth(n, max_vertices); depth > level_depth; ) {
+        depth -= level_depth;
+        level_ranges.push_back(subtrees(n, max_vertices, depth));
+    }
+    const std::vector<Range> &ranges = level_ranges[0];
+    uint32_t num_cells = ranges.size();
+    uint32_t num_levels = level_ranges.size();
+
+    std::vector<uint32_t> renumber(n);
+    for (uint32_t v = 0; v < n; v++) {
+        renumber[order[v]] = v;
+    }
+    // cell_at[l][v] is the cell of level l holding vertex v
+    std::vector<std::vector<uint32_t>> cell_at(num_levels,
+        std::vector<uint32_t>(n));
+    for (uint32_t l = 0; l < num_levels; l++) {
+        for (uint32_t c = 0; c < level_ranges[l].size(); c++) {
+            for (uint32_t v = level_ranges[l][c].begin;
+                    v < level_ranges[l][c].end; v++) {
+                cell_at[l][v] = c;
+            }
+        }
+    }
+    // the highest level where a and b are in different cells, or -1
+    auto cut_level_of = [&](uint32_t a, uint32_t b) {
+        int l = num_levels - 1;
+        while (l >= 0 && cell_at[l][a] == cell_at[l][b]) {
+            l--;
+        }
+        return l;
+    };
+
+    // a vertex is a boundary vertex of the levels below top[v]
+    std::vector<uint8_t> top(n, 0);
+    for (uint32_t u = 0; u < n; u++) {
+        for (uint32_t e = map.first_out[u]; e < map.first_out[u + 1]; e++) {
+            uint32_t a = renumber[u], b = renumber[map.head[e]];
+            int l = cut_level_of(a, b);
+            top[a] = std::max<int>(top[a], l + 1);
+            top[b] = std::max<int>(top[b], l + 1);
+        }
+    }
+
+    // boundary vertices of each level, numbered in vertex order so each
+    // cell's are together and ascending
+    struct Level {
+        std::vector<LevelCell> cells;
+        std::vector<uint32_t> boundary_vertex, boundary_of, cliques;
+        uint64_t clique_size = 0;
+    };
+    std::vector<Level> levels(num_levels);
+    for (uint32_t l = 0; l < num_levels; l++) {
+        Level &level = levels[l];
+        level.boundary_of.assign(n, (uint32_t) RoadMap::no_vertex);
+        for (const Range &r : level_ranges[l]) {
+            LevelCell cell = LevelCell();
+            cell.first_vertex = r.begin;
+            cell.num_vertices = r.end - r.begin;
+            cell.first_boundary = level.boundary_vertex.size();
+            for (uint32_t v = r.begin; v < r.end; v++) {
+                if (top[v] > l) {
+                    level.boundary_of[v] = level.boundary_vertex.size();
+                    level.boundary_vertex.push_back(v);
+                }
+            }
+            cell.num_boundary =
+                level.boundary_vertex.size() - cell.first_boundary;
+            cell.clique_offset = level.clique_size;
+            level.clique_size +=
+                (uint64_t) cell.num_boundary * cell.num_boundary;
+            level.cells.push_back(cell);
+        }
+        level.cliques.assign(level.clique_size, no_distance);
+    }
+    Level &bottom = levels[0];
+
+    // the edges leaving each bottom boundary vertex, highest level first
+    std::vector<uint32_t> cut_first, cut_head, cut_weight, cut_level;
+    std::vector<std::pair<int, uint32_t>> cuts;     // (level, edge)
+    for (uint32_t v : bottom.boundary_vertex) {
+        cut_first.push_back(cut_head.size());
+        uint32_t u = order[v];
+        cuts.clear();
+        for (uint32_t e = map.first_out[u]; e < map.first_out[u + 1]; e++) {
+            int l = cut_level_of(v, renumber[map.head[e]]);
+            if (l >= 0) {
+                cuts.push_back({l, e});
+            }
+        }
+        std::stable_sort(cuts.begin(), cuts.end(),
+            [](const std::pair<int, uint32_t> &a,
+                    const std::pair<int, uint32_t> &b) {
+                return a.first > b.first;
+            });
+        for (auto [l, e] : cuts) {
+            cut_head.push_back(bottom.boundary_of[renumber[map.head[e]]]);
+            cut_weight.push_back(map.weight[e]);
+            cut_level.push_back(l);
+        }
+    }
+    cut_first.push_back(cut_head.size());
+
+    // distances across each bottom cell between its boundary vertices
+    parallel_for(num_cells, num_threads, [&](size_t c) {
+        const LevelCell &cell = bottom.cells[c];
+        std::vector<uint32_t> dist(cell.num_vertices);
+        MinQueue queue;
+        for (uint32_t i = 0; i < cell.num_boundary; i++) {
+            uint32_t source = bottom.boundary_vertex[cell.first_boundary + i];
+            std::fill(dist.begin(), dist.end(), no_distance);
+            dist[source - cell.first_vertex] = 0;
+            queue.push({0, source});
+            while (!queue.empty()) {
+                auto [d, v] = queue.top();
+                queue.pop();
+                if (d > dist[v - cell.first_vertex]) {
+                    continue;
+                }
+                uint32_t u = order[v];
+                for (uint32_t e = map.first_out[u]; e < map.first_out[u + 1];
+                        e++) {
+                    uint32_t w = renumber[map.head[e]];
+                    if (cell_at[0][w] != c) {
+                        continue;
+                    }
+                    uint32_t &dw = dist[w - cell.first_vertex];
+                    if (d + map.weight[e] < dw) {
+                        dw = d + map.weight[e];
+                        queue.push({dw, w});
+                    }
+                }
+            }
+            uint32_t *row = &bottom.cliques[cell.clique_offset
+                + (uint64_t) i * cell.num_boundary];
+            for (uint32_t j = 0; j < cell.num_boundary; j++) {
+                row[j] = dist[bottom.boundary_vertex[cell.first_boundary + j]
+                    - cell.first_vertex];
+            }
+        }
+    });
+
+    // and across each cell higher up, over the cliques of the level below
+    // and the cut edges between its cells
+    for (uint32_t l = 1; l < num_levels; l++) {
+        Level &level = levels[l];
+        const Level &below = levels[l - 1];
+        parallel_for(level.cells.size(), num_threads, [&](size_t c) {
+            const LevelCell &cell = level.cells[c];
+            // the boundary vertices of the level below inside the cell,
+            // as the range lo .. hi-1 of their indices
+            auto begin = below.boundary_vertex.begin();
+            uint32_t lo = std::lower_bound(begin, below.boundary_vertex.end(),
+                cell.first_vertex) - begin;
+            uint32_t hi = std::lower_bound(begin, below.boundary_vertex.end(),
+                cell.first_vertex + cell.num_vertices) - begin;
+            std::vector<uint32_t> dist(hi - lo);
+            MinQueue queue;     // (distance, boundary index below)
+            auto relax = [&](uint32_t x, uint32_t d) {
+                if (d < dist[x - lo]) {
+                    dist[x - lo] = d;
+                    queue.push({d, x});
+                }
+            };
+            for (uint32_t i = 0; i < cell.num_boundary; i++) {
+                uint32_t source =
+                    level.boundary_vertex[cell.first_boundary + i];
+                std::fill(dist.begin(), dist.end(), no_distance);
+                relax(below.boundary_of[source], 0);
+                while (!queue.empty()) {
+                    auto [d, x] = queue.top();
+                    queue.pop();
+                    if (d > dist[x - lo]) {
+                        continue;
+                    }
+                    uint32_t v = below.boundary_vertex[x];
+                    const LevelCell &sub = below.cells[cell_at[l - 1][v]];
+                    const uint32_t *row = &below.cliques[sub.clique_offset
+                        + (uint64_t) (x - sub.first_boundary)
+                        * sub.num_boundary];
+                    for (uint32_t j = 0; j < sub.num_boundary; j++) {
+                        if (row[j] != no_distance) {
+                            relax(sub.first_boundary + j, d + row[j]);
+                        }
+                    }
+                    // edges of a higher level leave the cell, and those of
+                    // a lower one are inside the clique
+                    uint32_t b = bottom.boundary_of[v];
+                    for (uint32_t k = cut_first[b]; k < cut_first[b + 1]; k++) {
+                        if (cut_level[k] == l - 1) {
+                            uint32_t w = bottom.boundary_vertex[cut_head[k]];
+                            relax(below.boundary_of[w], d + cut_weight[k]);
+                        }
+                    }
+                }
+                uint32_t *row = &level.cliques[cell.clique_offset
+                    + (uint64_t) i * cell.num_boundary];
+                for (uint32_t j = 0; j < cell.num_boundary; j++) {
+                    uint32_t w = level.boundary_vertex[cell.first_boundary + j];
+                    row[j] = dist[below.boundary_of[w] - lo];
+                }
+            }
+        });
+    }
+
+    // lay out the file
+    std::vector<CellInfo> info(num_cells);
+    std::vector<LevelInfo> level_info(num_levels);
+    for (uint32_t l = 0; l < num_levels; l++) {
+        level_info[l].num_cells = levels[l].cells.size();
+        level_info[l].num_boundary = levels[l].boundary_vertex.size();
+        level_info[l].clique_size = levels[l].clique_size;
+    }
+    OverlayLayout layout = overlay_layout(cut_head.size(), level_info.data(),
+        num_levels);
+
+    CellGraphHeader header;
+    std::memcpy(header.magic, "CELL", 4);
+    header.version = cell_graph_version;
+    header.num_vertices = n;
+    header.num_edges = map.num_edges();
+    header.num_cells = num_cells;
+    header.num_levels = num_levels;
+    header.num_cut_edges = cut_head.size();
+    header.page_size = page_size;
+    header.overlay_offset = page_align(sizeof(header)
+        + num_cells * sizeof(CellInfo) + num_levels * sizeof(LevelInfo),
+        page_size);
+    header.overlay_size = layout.size;
+
+    uint64_t offset = page_align(header.overlay_offset + header.overlay_size,
+        page_size);
+    for (uint32_t c = 0; c < num_cells; c++) {
+        CellInfo &cell = info[c];
+        cell = CellInfo();
+        cell.first_vertex = ranges[c].begin;
+        cell.num_vertices = ranges[c].end - ranges[c].begin;
+        cell.min_lat = cell.min_lon = INT32_MAX;
+        cell.max_lat = cell.max_lon = INT32_MIN;
+        for (uint32_t v = ranges[c].begin; v < ranges[c].end; v++) {
+            uint32_t u = order[v];
+            cell.num_edges += map.first_out[u + 1] - map.first_out[u];
+            cell.min_lat = std::min(cell.min_lat, map.lat[u]);
+            cell.max_lat = std::max(cell.max_lat, map.lat[u]);
+            cell.min_lon = std::min(cell.min_lon, map.lon[u]);
+            cell.max_lon = std::max(cell.max_lon, map.lon[u]);
+        }
+        cell.offset = offset;
+        cell.size = 8 * (uint64_t) cell.num_vertices
+            + 4 * (4 * (uint64_t) cell.num_vertices + 1)
+            + 8 * (uint64_t) cell.num_edges;
+        offset = page_align(offset + cell.size, page_size);
+    }
+
+    Writer out(out_path);
+    out.write(&header, sizeof(header));
+    out.write(info);
+    out.write(level_info);
+    uint64_t overlay = header.overlay_offset;
+    out.pad_to(overlay + layout.cut_first);
+    out.write(cut_first);
+    out.pad_to(overlay + layout.cut_head);
+    out.write(cut_head);
+    out.pad_to(overlay + layout.cut_weight);
+    out.write(cut_weight);
+    out.pad_to(overlay + layout.cut_level);
+    out.write(cut_level);
+    for (uint32_t l = 0; l < num_levels; l++) {
+        out.pad_to(overlay + layout.cells[l]);
+        out.write(levels[l].cells);
+        out.pad_to(overlay + layout.boundary_vertex[l]);
+        out.write(levels[l].boundary_vertex);
+        out.pad_to(overlay + layout.cliques[l]);
+        out.write(levels[l].cliques);
+    }
+
+    for (uint32_t c = 0; c < num_cells; c++) {
+        const CellInfo &cell = info[c];
+        std::vector<int64_t> vertex_id;
+        std::vector<int32_t> lat, lon;
+        std::vector<uint32_t> boundary, first_out, head, weight;
+        for (uint32_t v = ranges[c].begin; v < ranges[c].end; v++) {
+            uint32_t u = order[v];
+            vertex_id.push_back(map.vertex_id[u]);
+            lat.push_back(map.lat[u]);
+            lon.push_back(map.lon[u]);
+            boundary.push_back(bottom.boundary_of[v]);
+            first_out.push_back(head.size());
+            for (uint32_t e = map.first_out[u]; e < map.first_out[u + 1]; e++) {
+                head.push_back(renumber[map.head[e]]);
+                weight.push_back(map.weight[e]);
+            }
+        }
+        first_out.push_back(head.size());
+
+        out.pad_to(cell.offset);
+        out.write(vertex_id);
+        out.write(lat);
+        out.write(lon);
+        out.write(boundary);
+        out.write(first_out);
+        out.write(head);
+        out.write(weight);
+    }
+    out.pad_to(page_align(out.offset, page_size));
+    out.close();
+}
+
+// a search reads a few cells, so no read ahead into the next ones
+CellGraph::CellGraph(const char *path)
+        : file_(path, MADV_RANDOM), overlay_read_(0) {
+    data_ = (const uint8_t *) file_.data;
+    size_t size = file_.size;
+    if (size < sizeof(CellGraphHeader)) {
+        throw std::runtime_error(std::string("not a cell graph file: ") + path);
+    }
+
+    header_ = (const CellGraphHeader *) data_;
+    uint64_t directory_end = sizeof(CellGraphHeader)
+        + (uint64_t) header_->num_cells * sizeof(CellInfo)
+        + (uint64_t) header_->num_levels * sizeof(LevelInfo);
+    if (std::memcmp(header_->magic, "CELL", 4) != 0
+            || header_->version != cell_graph_version
+            || header_->num_levels == 0
+            || directory_end > header_->overlay_offset
+            || header_->overlay_offset > size
+            || header_->overlay_size > size - header_->overlay_offset) {
+        throw std::runtime_error(std::string("not a cell graph file: ") + path);
+    }
+    cells_ = (const CellInfo *) (data_ + sizeof(CellGraphHeader));
+    if (!cells_valid(cells_, header_->num_cells, header_->num_vertices,
+            size)) {
+        throw std::runtime_error(std::string("corrupt cell graph: ") + path);
+    }
+
+    // the overlay must be exactly the arrays its counts call for, and
+    // searches index it unchecked, so a corrupt file is caught here
+    const LevelInfo *info = (const LevelInfo *) (cells_ + header_->num_cells);
+    for (uint32_t l = 0; l < header_->num_levels; l++) {
+        if (info[l].clique_size > header_->overlay_size / 4) {
+            throw std::runtime_error(std::string("corrupt cell graph: ")
+                + path);
+        }
+    }
+    OverlayLayout layout = overlay_layout(header_->num_cut_edges, info,
+        header_->num_levels);
+    if (layout.size != header_->overlay_size) {
+        throw std::runtime_error(std::string("corrupt cell graph: ") + path);
+    }
+    const uint8_t *overlay = data_ + header_->overlay_offset;
+    cut_first_ = (const uint32_t *) (overlay + layout.cut_first);
+    cut_head_ = (const uint32_t *) (overlay + layout.cut_head);
+    cut_weight_ = (const uint32_t *) (overlay + layout.cut_weight);
+    cut_level_ = (const uint32_t *) (overlay + layout.cut_level);
+    std::vector<uint32_t> starts;
+    for (uint32_t c = 0; c < header_->num_cells; c++) {
+        starts.push_back(cells_[c].first_vertex);
+    }
+    for (uint32_t l = 0; l < header_->num_levels; l++) {
+        Level level;
+        level.num_cells = info[l].num_cells;
+        level.num_boundary = info[l].num_boundary;
+        level.cells = (const LevelCell *) (overlay + layout.cells[l]);
+        level.boundary_vertex =
+            (const uint32_t *) (overlay + layout.boundary_vertex[l]);
+        level.cliques = (const uint32_t *) (overlay + layout.cliques[l]);
+        // level 0 is the bottom cells themselves
+        if (!level_valid(info[l], level.cells, level.boundary_vertex,
+                    header_->num_vertices, starts)
+                || (l == 0 && level.num_cells != header_->num_cells)) {
+            throw std::runtime_error(std::string("corrupt cell graph: ")
+                + path);
+        }
+        starts.clear();
+        for (uint32_t c = 0; c < level.num_cells; c++) {
+            starts.push_back(level.cells[c].first_vertex);
+        }
+        levels_.push_back(level);
+    }
+    if (!cut_edges_valid(cut_first_, cut_head_, cut_level_,
+            levels_[0].num_boundary, header_->num_cut_edges,
+            header_->num_levels)) {
+        throw std::runtime_error(std::string("corrupt cell graph: ") + path);
+    }
+
+    touched_.reset(new std::atomic<bool>[header_->num_cells]);
+    for (uint32_t c = 0; c < header_->num_cells; c++) {
+        touched_[c] = false;
+    }
+}
+
+uint32_t CellGraph::num_cells(uint32_t level) const {
+    return levels_[level].num_cells;
+}
+
+uint32_t CellGraph::num_boundary(uint32_t level) const {
+    return levels_[level].num_boundary;
+}
+
+uint32_t CellGraph::cell_of(uint32_t v) const {
+    // the last cell starting at or before v
+    uint32_t lo = 0, hi = header_->num_cells;
+    while (hi - lo > 1) {
+        uint32_t mid = (lo + hi) / 2;
+        if (cells_[mid].first_vertex <= v) {
+            lo = mid;
+        } else {
+            hi = mid;
+        }
+    }
+    return lo;
+}
+
+uint32_t CellGraph::level_cell(uint32_t level, uint32_t v) const {
+    const LevelCell *cells = levels_[level].cells;
+    uint32_t lo = 0, hi = levels_[level].num_cells;
+    while (hi - lo > 1) {
+        uint32_t mid = (lo + hi) / 2;
+        if (cells[mid].first_vertex <= v) {
+            lo = mid;
+        } else {
+            hi = mid;
+        }
+    }
+    return lo;
+}
+
+CellGraph::CellView CellGraph::cell(uint32_t c) const {
+    const CellInfo &info = cells_[c];
+    if (!touched_[c].load(std::memory_order_relaxed)) {
+        touched_[c].store(true, std::memory_order_relaxed);
+    }
+
+    CellView view;
+    uint32_t nv = info.num_vertices;
+    view.first_vertex = info.first_vertex;
+    view.num_vertices = nv;
+    const uint8_t *p = data_ + info.offset;
+    view.vertex_id = (const int64_t *) p;
+    view.lat = (const int32_t *) (p + 8 * (uint64_t) nv);
+    view.lon = view.lat + nv;
+    view.boundary = (const uint32_t *) (view.lon + nv);
+    view.first_out = view.boundary + nv;
+    view.head = view.first_out + nv + 1;
+    view.weight = view.head + info.num_edges;
+    return view;
+}
+
+int64_t CellGraph::vertex_id(uint32_t v) const {
+    CellView view = cell(cell_of(v));
+    return view.vertex_id[v - view.first_vertex];
+}
+
+int32_t CellGraph::lat(uint32_t v) const {
+    CellView view = cell(cell_of(v));
+    return view.lat[v - view.first_vertex];
+}
+
+int32_t CellGraph::lon(uint32_t v) const {
+    CellView view = cell(cell_of(v));
+    return view.lon[v - view.first_vertex];
+}
+
+uint32_t CellGraph::boundary_index(uint32_t level, uint32_t c,
+        uint32_t v) const {
+    const Level &l = levels_[level];
+    const uint32_t *begin = l.boundary_vertex + l.cells[c].first_boundary;
+    const uint32_t *end = begin + l.cells[c].num_boundary;
+    const uint32_t *it = std::lower_bound(begin, end, v);
+    if (it == end || *it != v) {
+        return RoadMap::no_vertex;
+    }
+    return it - l.boundary_vertex;
+}
+
+// the distances from boundary vertex b of cell c across the cell
+const uint32_t *CellGraph::clique_row(uint32_t level, uint32_t c,
+        uint32_t b) const {
+    const LevelCell &cell = levels_[level].cells[c];
+    return levels_[level].cliques + cell.clique_offset
+        + (uint64_t) (b - cell.first_boundary) * cell.num_boundary;
+}
+
+uint32_t CellGraph::nearest(int32_t lat, int32_t lon) const {
+    // cells by the distance from the point to their bounding box
+    std::vector<std::pair<int64_t, uint32_t>> by_distance;
+    for (uint32_t c = 0; c < header_->num_cells; c++) {
+        const CellInfo &info = cells_[c];
+        int64_t dlat = std::max<int64_t>({0, (int64_t) info.min_lat - lat,
+            (int64_t) lat - info.max_lat});
+        int64_t dlon = std::max<int64_t>({0, (int64_t) info.min_lon - lon,
+            (int64_t) lon - info.max_lon});
+        by_distance.push_back({dlat * dlat + dlon * dlon, c});
+    }
+    std::sort(by_distance.begin(), by_distance.end());
+
+    int64_t best = INT64_MAX;
+    uint32_t best_vertex = RoadMap::no_vertex;
+    for (auto [box_distance, c] : by_distance) {
+        if (box_distance >= best) {
+            break;
+        }
+        CellView view = cell(c);
+        for (uint32_t i = 0; i < view.num_vertices; i++) {
+            int64_t dlat = (int64_t) view.lat[i] - lat;
+            int64_t dlon = (int64_t) view.lon[i] - lon;
+            int64_t d = dlat * dlat + dlon * dlon;
+            if (d < best) {
+                best = d;
+                best_vertex = view.first_vertex + i;
+            }
+        }
+    }
+    return best_vertex;
+}
+
+bool CellGraph::route(uint32_t s, uint32_t t, std::vector<uint32_t> &path,
+        uint32_t *cost) const {
+    path.clear();
+    if (s >= num_vertices() || t >= num_vertices()) {
+        return false;
+    }
+
+    struct Node {
+        uint32_t dist;
+        uint32_t parent;
+        int level;          // of the overlay step across a cell that
+                            // reached it, or -1 for an edge
+    };
+    std::unordered_map<uint32_t, Node> nodes;
+    MinQueue queue;
+    auto relax = [&](uint32_t w, uint32_t d, uint32_t parent, int level) {
+        auto it = nodes.find(w);
+        if (it == nodes.end() || d < it->second.dist) {
+            nodes[w] = {d, parent, level};
+            queue.push({d, w});
+        }
+    };
+
+    // the cells holding s and t at each level
+    uint32_t num_levels = levels_.size();
+    std::vector<uint32_t> source_cell(num_levels), target_cell(num_levels);
+    for (uint32_t l = 0; l < num_levels; l++) {
+        source_cell[l] = level_cell(l, s);
+        target_cell[l] = level_cell(l, t);
+    }
+
+    uint64_t read = 0;
+    nodes[s] = {0, s, -1};
+    queue.push({0, s});
+    bool found = false;
+    while (!queue.empty()) {
+        auto [d, u] = queue.top();
+        queue.pop();
+        if (d > nodes[u].dist) {
+            continue;
+        }
+        if (u == t) {
+            found = true;
+            break;
+        }
+
+        uint32_t c = cell_of(u);
+        if (c == source_cell[0] || c == target_cell[0]) {
+            CellView view = cell(c);
+            uint32_t i = u - view.first_vertex;
+            for (uint32_t e = view.first_out[i]; e < view.first_out[i + 1]; e++) {
+                relax(view.head[e], d + view.weight[e], u, -1);
+            }
+            continue;
+        }
+
+        // the highest level at which u's cell holds neither end; u is
+        // one of its boundary vertices, entered or left over a cut edge
+        uint32_t level = num_levels;
+        do {
+            level--;
+            c = level_cell(level, u);
+        } while (c == source_cell[level] || c == target_cell[level]);
+        uint32_t b = boundary_index(level, c, u);
+        if (b == RoadMap::no_vertex) {
+            continue;
+        }
+        const Level &l = levels_[level];
+        const LevelCell &info = l.cells[c];
+        const uint32_t *row = clique_row(level, c, b);
+        for (uint32_t j = 0; j < info.num_boundary; j++) {
+            if (row[j] != no_distance && info.first_boundary + j != b) {
+                relax(l.boundary_vertex[info.first_boundary + j], d + row[j],
+                    u, level);
+            }
+        }
+        read += 4 * (uint64_t) info.num_boundary;
+
+        // the cut edges leaving the cell come first
+        uint32_t b0 = level == 0 ? b : boundary_index(0, cell_of(u), u);
+        uint32_t k = cut_first_[b0];
+        for (; k < cut_first_[b0 + 1] && cut_level_[k] >= level; k++) {
+            relax(levels_[0].boundary_vertex[cut_head_[k]],
+                d + cut_weight_[k], u, -1);
+        }
+        read += 16 * (uint64_t) (k - cut_first_[b0]);
+    }
+    overlay_read_.fetch_add(read, std::memory_order_relaxed);
+    if (!found) {
+        return false;
+    }
+    if (cost) {
+        *cost = nodes[t].dist;
+    }
+
+    // walk back from t, filling in the overlay steps
+    std::vector<uint32_t> across;
+    for (uint32_t v = t; v != s; ) {
+        const Node &node = nodes[v];
+        path.push_back(v);
+        if (node.level >= 0) {
+            if (!unpack(node.level, node.parent, v, across)) {
+                // the overlay does not match the cells
+                path.clear();
+                return false;
+            }
+            for (size_t i = across.size() - 2; i > 0; i--) {
+                path.push_back(across[i]);
+            }
+        }
+        v = node.parent;
+    }
+    path.push_back(s);
+    std::reverse(path.begin(), path.end());
+    return true;
+}
+
+/*
+    The vertices of a shortest path from boundary vertex from to boundary
+  vertex to of the same cell of level, inside the cell, found over the
+  boundary vertices of the level below and unpacked in turn.
+*/
+bool CellGraph::unpack(uint32_t level, uint32_t from, uint32_t to,
+        std::vector<uint32_t> &path) const {
+    if (level == 0) {
+        return cell_path(cell_of(from), from, to, path);
+    }
+    path.clear();
+    uint32_t sub_level = level - 1;
+    const Level &below = levels_[sub_level];
+    const LevelCell &cell = levels_[level].cells[level_cell(level, from)];
+    const uint32_t *begin = below.boundary_vertex;
+    const uint32_t *end = begin + below.num_boundary;
+    uint32_t lo = std::lower_bound(begin, end, cell.first_vertex) - begin;
+    uint32_t hi = std::lower_bound(begin, end,
+        cell.first_vertex + cell.num_vertices) - begin;
+    uint32_t source = boundary_index(sub_level, level_cell(sub_level, from),
+        from);
+    uint32_t target = boundary_index(sub_level, level_cell(sub_level, to), to);
+    if (source < lo || source >= hi || target < lo || target >= hi) {
+        return false;
+    }
+
+    // boundary indices below, less lo
+    std::vector<uint32_t> dist(hi - lo, no_distance);
+    std::vector<uint32_t> parent(hi - lo, RoadMap::no_vertex);
+    std::vector<bool> across(hi - lo, false);
+    MinQueue queue;
+    auto relax = [&](uint32_t x, uint32_t d, uint32_t prev, bool clique) {
+        if (x >= lo && x < hi && d < dist[x - lo]) {
+            dist[x - lo] = d;
+            parent[x - lo] = prev;
+            across[x - lo] = clique;
+            queue.push({d, x});
+        }
+    };
+    uint64_t read = 0;
+    dist[source - lo] = 0;
+    queue.push({0, source});
+    while (!queue.empty()) {
+        auto [d, x] = queue.top();
+        queue.pop();
+        if (x == target) {
+            break;
+        }
+        if (d > dist[x - lo]) {
+            continue;
+        }
+        uint32_t v = below.boundary_vertex[x];
+        uint32_t c = level_cell(sub_level, v);
+        const LevelCell &sub = below.cells[c];
+        const uint32_t *row = clique_row(sub_level, c, x);
+        for (uint32_t j = 0; j < sub.num_boundary; j++) {
+            if (row[j] != no_distance) {
+                relax(sub.first_boundary + j, d + row[j], x, true);
+            }
+        }
+        read += 4 * (uint64_t) sub.num_boundary;
+
+        // edges of a higher level leave the cell, and those of a lower
+        // one are inside the clique
+        uint32_t b = boundary_index(0, cell_of(v), v);
+        for (uint32_t k = cut_first_[b]; k < cut_first_[b + 1]; k++) {
+            if (cut_level_[k] == sub_level) {
+                uint32_t w = levels_[0].boundary_vertex[cut_head_[k]];
+                relax(boundary_index(sub_level, level_cell(sub_level, w), w),
+                    d + cut_weight_[k], x, false);
+            }
+        }
+        read += 16 * (uint64_t) (cut_first_[b + 1] - cut_first_[b]);
+    }
+    overlay_read_.fetch_add(read, std::memory_order_relaxed);
+    if (dist[target - lo] == no_distance) {
+        return false;
+    }
+
+    std::vector<uint32_t> steps;
+    for (uint32_t x = target; x != source; x = parent[x - lo]) {
+        steps.push_back(x);
+    }
+    path.push_back(from);
+    std::vector<uint32_t> inner;
+    for (size_t i = steps.size(); i-- > 0; ) {
+        uint32_t x = steps[i];
+        uint32_t w = below.boundary_vertex[x];
+        if (across[x - lo]) {
+            if (!unpack(sub_level, path.back(), w, inner)) {
+                return false;
+            }
+            path.insert(path.end(), inner.begin() + 1, inner.end());
+        } else {
+            path.push_back(w);
+        }
+    }
+    return true;
+}
+
+bool CellGraph::cell_path(uint32_t c, uint32_t from, uint32_t to,
+        std::vector<uint32_t> &path) const {
+    CellView view = cell(c);
+    uint32_t first = view.first_vertex;
+    path.clear();
+    if (to < first || to - first >= view.num_vertices) {
+        return false;
+    }
+    std::vector<uint32_t> dist(view.num_vertices, no_distance);
+    std::vector<uint32_t> parent(view.num_vertices, RoadMap::no_vertex);
+    MinQueue queue;
+    dist[from - first] = 0;
+    queue.push({0, from});
+    while (!queue.empty()) {
+        auto [d, u] = queue.top();
+        queue.pop();
+        if (u == to) {
+            break;
+        }
+        if (d > dist[u - first]) {
+            continue;
+        }
+        uint32_t i = u - first;
+        for (uint32_t e = view.first_out[i]; e < view.first_out[i + 1]; e++) {
+            uint32_t w = view.head[e];
+            if (w < first || w - first >= view.num_vertices) {
+                continue;
+            }
+            if (d + view.weight[e] < dist[w - first]) {
+                dist[w - first] = d + view.weight[e];
+                parent[w - first] = u;
+                queue.push({dist[w - first], w});
+            }
+        }
+    }
+
+    if (dist[to - first] == no_distance) {
+        return false;
+    }
+    for (uint32_t v = to; v != from; v = parent[v - first]) {
+        path.push_back(v);
+    }
+    path.push_back(from);
+    std::reverse(path.begin(), path.end());
+    return true;
+}
+
+uint32_t CellGraph::cells_touched() const {
+    uint32_t touched = 0;
+    for (uint32_t c = 0; c < header_->num_cells; c++) {
+        touched += touched_[c].load(std::memory_order_relaxed);
+    }
+    return touched;
+}
+
+uint64_t CellGraph::bytes_touched() const {
+    uint64_t bytes = 0;
+    for (uint32_t c = 0; c < header_->num_cells; c++) {
+        if (touched_[c].load(std::memory_order_relaxed)) {
+            bytes += cells_[c].size;
+        }
+    }
+    return bytes;
+}
+
+uint64_t CellGraph::overlay_bytes() const {
+    return header_->overlay_offset + header_->overlay_size;
+}
+
+uint64_t CellGraph::overlay_read() const {
+    return overlay_read_.load(std::memory_order_relaxed);
+}
@@ -0,0 +1,217 @@
+/*
+ The road map split into geographic cells and stored so that a search
+ reads only the cells it passes through.
+
+ The vertices are cut into cells of at most a few thousand vertices each
+ by recursive bisection on latitude and longitude.  The vertices of a
+ cell are numbered together, and the cell's vertices and edges are
+ written as one page aligned block of the file.  The overlay, kept apart
+ from the cells, has several levels: the cells of level 0 are these
+ bottom cells, and each level above joins the cells below it that came
+ from the same few bisection steps.  A vertex with an edge to or from
+ another cell of a level is a boundary vertex of that level, and the
+ overlay holds for every cell of every level the shortest distances
+ within it between its boundary vertices, and the edges that cross
+ between cells.
+
+ A search from s to t walks the full graph only inside the bottom cells
+ of s and t.  Elsewhere it crosses a cell in one step, using the highest
+ level whose cell holds neither s nor t, so far from the ends it moves
+ between a few large cells.  Only the two end cells are read; the cells
+ along the route are read afterwards to fill in the steps across them,
+ level by level.  With the file mapped, memory use follows the region of
+ the query rather than the size of the map, which can be far larger than
+ RAM.
+ */
+
+#ifndef CELL_GRAPH_H
+#define CELL_GRAPH_H
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+#include "parallel.h"
+#include "road_map.h"
+
+/*
+    Partition map into cells of at most max_cell_vertices vertices and
+  write the cell graph to out_path, using up to num_threads threads (0
+  picks one per core).  Throws std::runtime_error if the file cannot be
+  written.
+*/
+void build_cell_graph(const RoadMap &map, const char *out_path,
+    uint32_t max_cell_vertices = 4096, unsigned num_threads = 0);
+
+/*
+    The file written by build_cell_graph is laid out, all integers
+  little-endian, as
+      header      CellGraphHeader
+      directory   CellInfo per bottom cell, then LevelInfo per level
+      overlay     from header.overlay_offset, each array starting on a
+                  multiple of 8 bytes:
+                      cut_first        uint32_t per level 0 boundary
+                                       vertex, and one past the last
+                      cut_head         uint32_t per cut edge, the level 0
+                                       boundary index of its end
+                      cut_weight       uint32_t per cut edge
+                      cut_level        uint32_t per cut edge, the highest
+                                       level where its ends are in
+                                       different cells
+                  then for each level
+                      cells            LevelCell per cell
+                      boundary_vertex  uint32_t per boundary vertex
+                      cliques          per cell, a num_boundary square
+                                       matrix of uint32_t distances
+      cells       from each CellInfo.offset, page aligned:
+                      vertex_id        int64_t per vertex
+                      lat, lon         int32_t per vertex
+                      boundary         uint32_t per vertex, its level 0
+                                       boundary index or no_vertex
+                      first_out        uint32_t per vertex, and one past
+                                       the last, into the cell's edges
+                      head             uint32_t per edge, a global vertex
+                      weight           uint32_t per edge
+  Global vertex numbers run through the cells in order, so the vertices
+  of a cell are first_vertex .. first_vertex+num_vertices-1, and every
+  cell of a level is a run of whole cells of the level below.  Boundary
+  indices of a level likewise run through its cells in order.  The cut
+  edges of a vertex are sorted by decreasing cut_level.
+*/
+struct CellGraphHeader {
+    char magic[4];              // "CELL"
+    uint32_t version;           // cell_graph_version
+    uint32_t num_vertices;
+    uint32_t num_edges;
+    uint32_t num_cells;         // bottom cells
+    uint32_t num_levels;
+    uint32_t num_cut_edges;
+    uint32_t page_size;
+    uint64_t overlay_offset;
+    uint64_t overlay_size;
+};
+
+struct CellInfo {
+    uint32_t first_vertex;
+    uint32_t num_vertices;
+    uint32_t num_edges;
+    uint32_t unused;
+    int32_t min_lat, min_lon, max_lat, max_lon;
+    uint64_t offset;            // of the cell block in the file
+    uint64_t size;
+};
+
+struct LevelInfo {
+    uint32_t num_cells;
+    uint32_t num_boundary;
+    uint64_t clique_size;       // in uint32_t
+};
+
+struct LevelCell {
+    uint32_t first_vertex;
+    uint32_t num_vertices;
+    uint32_t first_boundary;
+    uint32_t num_boundary;
+    uint64_t clique_offset;     // in uint32_t from the start of the cliques
+};
+
+extern const uint32_t cell_graph_version;
+
+class CellGraph {
+public:
+    // Map the cell graph at path.  Throws std::runtime_error if it cannot
+    // be read or is not a cell graph file.
+    explicit CellGraph(const char *path);
+
+    CellGraph(const CellGraph &) = delete;
+    CellGraph &operator=(const CellGraph &) = delete;
+
+    uint32_t num_vertices() const { return header_->num_vertices; }
+    uint32_t num_edges() const { return header_->num_edges; }
+    uint32_t num_cells() const { return header_->num_cells; }
+    uint32_t num_levels() const { return header_->num_levels; }
+
+    // the cells and boundary vertices of an overlay level
+    uint32_t num_cells(uint32_t level) const;
+    uint32_t num_boundary(uint32_t level) const;
+
+    // the bottom cell holding vertex v
+    uint32_t cell_of(uint32_t v) const;
+
+    // the id and fixed point position of vertex v
+    int64_t vertex_id(uint32_t v) const;
+    int32_t lat(uint32_t v) const;
+    int32_t lon(uint32_t v) const;
+
+    // the vertex closest to a fixed point position, reading only the
+    // cells that could hold a closer one than already found
+    uint32_t nearest(int32_t lat, int32_t lon) const;
+
+    /*
+        The vertices of a shortest path from s to t, with its cost in
+      *cost if that is not null.  Returns false, and leaves path empty, if
+      t cannot be reached from s.  Safe to call from several threads.
+    */
+    bool route(uint32_t s, uint32_t t, std::vector<uint32_t> &path,
+        uint32_t *cost = nullptr) const;
+
+    // the number of cells whose blocks have been read since the file was
+    // mapped, and their total bytes
+    uint32_t cells_touched() const;
+    uint64_t bytes_touched() const;
+
+    // bytes of the file that every search may read: header, directory
+    // and overlay
+    uint64_t overlay_bytes() const;
+
+    // bytes of the overlay read by searches since the file was mapped
+    uint64_t overlay_read() const;
+
+private:
+    // the arrays of one cell block
+    struct CellView {
+        uint32_t first_vertex;
+        uint32_t num_vertices;
+        const int64_t *vertex_id;
+        const int32_t *lat;
+        const int32_t *lon;
+        const uint32_t *boundary;
+        const uint32_t *first_out;
+        const uint32_t *head;
+        const uint32_t *weight;
+    };
+
+    // the arrays of one overlay level
+    struct Level {
+        uint32_t num_cells;
+        uint32_t num_boundary;
+        const LevelCell *cells;
+        const uint32_t *boundary_vertex;
+        const uint32_t *cliques;
+    };
+
+    CellView cell(uint32_t c) const;
+    uint32_t level_cell(uint32_t level, uint32_t v) const;
+    uint32_t boundary_index(uint32_t level, uint32_t c, uint32_t v) const;
+    const uint32_t *clique_row(uint32_t level, uint32_t c, uint32_t b) const;
+    bool unpack(uint32_t level, uint32_t from, uint32_t to,
+        std::vector<uint32_t> &path) const;
+    bool cell_path(uint32_t c, uint32_t from, uint32_t to,
+        std::vector<uint32_t> &path) const;
+
+    MappedFile file_;
+    const uint8_t *data_;
+    const CellGraphHeader *header_;
+    const CellInfo *cells_;
+    const uint32_t *cut_first_;
+    const uint32_t *cut_head_;
+    const uint32_t *cut_weight_;
+    const uint32_t *cut_level_;
+    std::vector<Level> levels_;
+    std::unique_ptr<std::atomic<bool>[]> touched_;
+    mutable std::atomic<uint64_t> overlay_read_;
+};
+
+#endif
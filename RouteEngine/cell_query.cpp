@@ -0,0 +1,138 @@
+/*
+ Time routes on a cell graph and report how much of the file each one
+ reads: the cell blocks, and the part of the overlay its search and the
+ unpacking of its overlay steps looked at.  Each route maps the file
+ afresh, so the cells counted are the ones that route needed.  Given
+ the road file as well, every route is checked against plain Dijkstra
+ on the whole map.
+
+ Usage: cell_query <cell file> [routes] [road file]
+ */
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <queue>
+#include <random>
+
+#include "cell_graph.h"
+
+// distance from s to t by Dijkstra, for checking
+static uint32_t dijkstra(const RoadMap &map, uint32_t s, uint32_t t) {
+    typedef std::pair<uint32_t, uint32_t> Item;
+    std::vector<uint32_t> dist(map.num_vertices(), no_distance);
+    std::priority_queue<Item, std::vector<Item>, std::greater<Item>> queue;
+    dist[s] = 0;
+    queue.push({0, s});
+    while (!queue.empty()) {
+        auto [d, u] = queue.top();
+        queue.pop();
+        if (u == t) {
+            return d;
+        }
+        if (d > dist[u]) {
+            continue;
+        }
+        for (uint32_t e = map.first_out[u]; e < map.first_out[u + 1]; e++) {
+            uint32_t w = map.head[e];
+            if (d + map.weight[e] < dist[w]) {
+                dist[w] = d + map.weight[e];
+                queue.push({dist[w], w});
+            }
+        }
+    }
+    return no_distance;
+}
+
+// the cost of a route along the edges of map, as map vertices, or
+// no_distance if it has a step that is not an edge
+static uint32_t route_cost(const RoadMap &map, const CellGraph &cells,
+        const std::vector<uint32_t> &route) {
+    uint32_t cost = 0;
+    for (size_t i = 1; i < route.size(); i++) {
+        uint32_t u = map.index_of(cells.vertex_id(route[i - 1]));
+        uint32_t w = map.index_of(cells.vertex_id(route[i]));
+        uint32_t e = map.first_out[u];
+        while (e < map.first_out[u + 1] && map.head[e] != w) {
+            e++;
+        }
+        if (e == map.first_out[u + 1]) {
+            return no_distance;
+        }
+        cost += map.weight[e];
+    }
+    return cost;
+}
+
+int main(int argc, char **argv) {
+    if (argc < 2) {
+        std::fprintf(stderr, "usage: %s <cell file> [routes] [road file]\n",
+            argv[0]);
+        return 2;
+    }
+    unsigned routes = argc > 2 ? std::atoi(argv[2]) : 100;
+
+    try {
+        std::unique_ptr<RoadMap> map;
+        if (argc > 3) {
+            map.reset(new RoadMap());
+            load_road_map(argv[3], *map);
+        }
+
+        std::mt19937 rng(1);
+        uint64_t cells_sum = 0, bytes_sum = 0, read_sum = 0, file_bytes = 0;
+        uint32_t num_cells = 0;
+        unsigned bad = 0;
+        double ms = 0;
+        std::vector<uint32_t> route;
+        for (unsigned i = 0; i < routes; i++) {
+            CellGraph cells(argv[1]);
+            num_cells = cells.num_cells();
+            file_bytes = cells.overlay_bytes();
+            uint32_t s = rng() % cells.num_vertices();
+            uint32_t t = rng() % cells.num_vertices();
+
+            auto start = std::chrono::steady_clock::now();
+            uint32_t cost = no_distance;
+            cells.route(s, t, route, &cost);
+            ms += std::chrono::duration<double, std::milli>(
+                std::chrono::steady_clock::now() - start).count();
+            cells_sum += cells.cells_touched();
+            bytes_sum += cells.bytes_touched();
+            read_sum += cells.overlay_read();
+
+            if (map) {
+                uint32_t expect = dijkstra(*map,
+                    map->index_of(cells.vertex_id(s)),
+                    map->index_of(cells.vertex_id(t)));
+                if (cost != expect || (expect != no_distance
+                        && route_cost(*map, cells, route) != expect)) {
+                    if (bad++ < 10) {
+                        std::printf("mismatch %u -> %u: dijkstra %u cells %u\n",
+                            s, t, expect, cost);
+                    }
+                }
+            }
+        }
+
+        std::printf("routes %u\nms per route %.2f\n"
+            "cells read per route %.1f of %u\n"
+            "cell bytes read per route %.0f\n"
+            "overlay bytes read per route %.0f of %llu\n",
+            routes, routes ? ms / routes : 0.0,
+            routes ? (double) cells_sum / routes : 0.0, num_cells,
+            routes ? (double) bytes_sum / routes : 0.0,
+            routes ? (double) read_sum / routes : 0.0,
+            (unsigned long long) file_bytes);
+        if (map) {
+            std::printf("checked %u, %u wrong\n", routes, bad);
+        }
+        return bad ? 1 : 0;
+    } catch (const std::exception &e) {
+        std::fprintf(stderr, "%s\n", e.what());
+        return 1;
+    }
+}
@@ -0,0 +1,235 @@
+#include "delta_stepping.h"
+
+#include <algorithm>
+
+#include "parallel.h"
+
+namespace {
+
+typedef std::pair<uint32_t, uint32_t> Item;     // (vertex, distance)
+
+// items a thread takes from a frontier at a time
+const size_t chunk_size = 128;
+
+} // namespace
+
+struct DeltaStepping::Worker {
+    // items this thread has put in each bucket, by bucket number
+    std::vector<std::vector<Item>> buckets;
+
+    // this thread's part of the current bucket, and the next item of it
+    // to hand out, to this thread or a thief
+    std::vector<Item> frontier;
+    std::atomic<size_t> next{0};
+
+    // vertices this thread first reached, to reset for the next run
+    std::vector<uint32_t> touched;
+
+    void put(uint32_t bucket, Item item) {
+        if (bucket >= buckets.size()) {
+            buckets.resize(bucket + 1);
+        }
+        buckets[bucket].push_back(item);
+    }
+};
+
+DeltaStepping::DeltaStepping(const RoadMap &map, unsigned num_threads,
+        uint32_t delta)
+    : map_(map), num_threads_(default_threads(num_threads)), delta_(delta),
+      budget_(no_distance), dist_(new std::atomic<uint32_t>[map.num_vertices()]) {
+    for (uint32_t v = 0; v < map.num_vertices(); v++) {
+        dist_[v].store(no_distance, std::memory_order_relaxed);
+    }
+    if (delta_ == 0) {
+        // a few average edges: wide enough that a round has plenty of
+        // vertices to share, narrow enough that few are relaxed twice
+        uint64_t total = 0;
+        for (uint32_t w : map.weight) {
+            total += w;
+        }
+        delta_ = std::max<uint64_t>(1,
+            4 * total / std::max<uint32_t>(1, map.num_edges()));
+    }
+    for (unsigned t = 0; t < num_threads_; t++) {
+        workers_.emplace_back(new Worker());
+    }
+
+    barrier_.reset(new Barrier(num_threads_));
+    stopping_ = false;
+    for (unsigned t = 1; t < num_threads_; t++) {
+        threads_.emplace_back([this, t] {
+            while (true) {
+                barrier_->wait();
+                if (stopping_) {
+                    break;
+                }
+                rounds(t);
+            }
+        });
+    }
+}
+
+DeltaStepping::~DeltaStepping() {
+    stopping_ = true;
+    barrier_->wait();
+    for (auto &thread : threads_) {
+        thread.join();
+    }
+}
+
+void DeltaStepping::relax(Worker &worker, uint32_t v, uint32_t d) {
+    if (d > dist_[v].load(std::memory_order_relaxed)) {
+        // improved since it was queued; the newer item will do
+        return;
+    }
+    for (uint32_t e = map_.first_out[v]; e < map_.first_out[v + 1]; e++) {
+        uint32_t w = map_.head[e];
+        uint32_t dw = d + map_.weight[e];
+        if (dw > budget_) {
+            continue;
+        }
+        uint32_t old = dist_[w].load(std::memory_order_relaxed);
+        while (dw < old) {
+            if (dist_[w].compare_exchange_weak(old, dw,
+                    std::memory_order_relaxed)) {
+                if (old == no_distance) {
+                    worker.touched.push_back(w);
+                }
+                worker.put(dw / delta_, {w, dw});
+                break;
+            }
+        }
+    }
+}
+
+void DeltaStepping::run(uint32_t s, uint32_t budget) {
+    for (auto &worker : workers_) {
+        for (uint32_t v : worker->touched) {
+            dist_[v].store(no_distance, std::memory_order_relaxed);
+        }
+        worker->touched.clear();
+        worker->buckets.clear();
+        worker->frontier.clear();
+    }
+    budget_ = budget;
+    dist_[s].store(0, std::memory_order_relaxed);
+    workers_[0]->touched.push_back(s);
+    workers_[0]->put(0, {s, 0});
+
+    current_ = 0;
+
+    // start the other threads on the run, and be thread 0 of it
+    barrier_->wait();
+    rounds(0);
+}
+
+void DeltaStepping::rounds(unsigned t) {
+    Worker &me = *workers_[t];
+    while (true) {
+        barrier_->wait();
+        if (t == 0) {
+            // the lowest bucket any thread has filled; everything below
+            // current_ is already done
+            uint32_t lowest = UINT32_MAX;
+            for (auto &worker : workers_) {
+                for (uint32_t b = current_; b < worker->buckets.size()
+                        && b < lowest; b++) {
+                    if (!worker->buckets[b].empty()) {
+                        lowest = b;
+                        break;
+                    }
+                }
+            }
+            // set every round, so a thread still to read the last round's
+            // done_ never sees it changed by the next run
+            done_ = lowest == UINT32_MAX;
+            if (!done_) {
+                current_ = lowest;
+                for (auto &worker : workers_) {
+                    worker->frontier.clear();
+                    if (current_ < worker->buckets.size()) {
+                        worker->frontier.swap(worker->buckets[current_]);
+                    }
+                    worker->next.store(0, std::memory_order_relaxed);
+                }
+            }
+        }
+        barrier_->wait();
+        if (done_) {
+            break;
+        }
+
+        // own part first, then steal from the others in turn
+        for (unsigned k = 0; k < num_threads_; k++) {
+            Worker &from = *workers_[(t + k) % num_threads_];
+            size_t size = from.frontier.size();
+            while (true) {
+                size_t begin = from.next.fetch_add(chunk_size,
+                    std::memory_order_relaxed);
+                if (begin >= size) {
+                    break;
+                }
+                size_t end = std::min(size, begin + chunk_size);
+                for (size_t i = begin; i < end; i++) {
+                    relax(me, from.frontier[i].first, from.frontier[i].second);
+                }
+            }
+        }
+    }
+}
+
+uint32_t DeltaStepping::distance(uint32_t v) const {
+    return dist_[v].load(std::memory_order_relaxed);
+}
+
+void DeltaStepping::reached(std::vector<uint32_t> &vertices) const {
+    vertices.clear();
+    for (auto &worker : workers_) {
+        vertices.insert(vertices.end(), worker->touched.begin(),
+            worker->touched.end());
+    }
+}
+
+std::vector<std::pair<int32_t, int32_t>> convex_hull(const RoadMap &map,
+        const std::vector<uint32_t> &vertices) {
+    // Andrew's monotone chain with x = lon and y = lat
+    std::vector<std::pair<int32_t, int32_t>> points;
+    for (uint32_t v : vertices) {
+        points.push_back({map.lon[v], map.lat[v]});
+    }
+    std::sort(points.begin(), points.end());
+    points.erase(std::unique(points.begin(), points.end()), points.end());
+
+    std::vector<std::pair<int32_t, int32_t>> hull;
+    if (points.size() < 3) {
+        hull = points;
+    } else {
+        auto cross = [](const std::pair<int32_t, int32_t> &o,
+                const std::pair<int32_t, int32_t> &a,
+                const std::pair<int32_t, int32_t> &b) {
+            return ((int64_t) a.first - o.first) * ((int64_t) b.second - o.second)
+                - ((int64_t) a.second - o.second) * ((int64_t) b.first - o.first);
+        };
+        hull.resize(2 * points.size());
+        size_t k = 0;
+        for (size_t i = 0; i < points.size(); i++) {
+            while (k >= 2 && cross(hull[k - 2], hull[k - 1], points[i]) <= 0) {
+                k--;
+            }
+            hull[k++] = points[i];
+        }
+        for (size_t i = points.size() - 1, lower = k + 1; i > 0; i--) {
+            while (k >= lower && cross(hull[k - 2], hull[k - 1], points[i - 1]) <= 0) {
+                k--;
+            }
+            hull[k++] = points[i - 1];
+        }
+        // the last corner is the first again
+        hull.resize(k - 1);
+    }
+
+    for (auto &corner : hull) {
+        std::swap(corner.first, corner.second);
+    }
+    return hull;
+}
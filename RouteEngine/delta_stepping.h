@@ -0,0 +1,94 @@
+/*
+ One-to-all and bounded radius searches by parallel delta-stepping, for
+ queries such as every vertex within a cost budget of a depot.
+
+ Distances are grouped into buckets delta wide.  All vertices in the
+ lowest non-empty bucket are relaxed at once, in parallel, and whatever
+ they improve goes back into the bucket it now belongs in; the bucket is
+ done when nothing lands in it again.  A larger delta gives each round
+ more work to share out and a smaller one wastes fewer relaxations on
+ distances that later improve.
+
+ Each thread keeps its own buckets.  A round starts with every thread
+ holding the part of the bucket it filled, works through its own part
+ first, and then steals chunks from the threads that still have some.
+ The threads are started with the search and wait between runs, so a
+ run costs no thread start up; the thread calling run is one of them.
+ */
+
+#ifndef DELTA_STEPPING_H
+#define DELTA_STEPPING_H
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include "road_map.h"
+
+class Barrier;
+
+class DeltaStepping {
+public:
+    /*
+        Prepare to search map with up to num_threads threads (0 picks one
+      per core) and buckets delta wide (0 picks a width from the edge
+      costs).
+    */
+    explicit DeltaStepping(const RoadMap &map, unsigned num_threads = 0,
+        uint32_t delta = 0);
+    ~DeltaStepping();
+
+    DeltaStepping(const DeltaStepping &) = delete;
+    DeltaStepping &operator=(const DeltaStepping &) = delete;
+
+    // Find the distance from s to every vertex within budget of it.  Only
+    // one run at a time.
+    void run(uint32_t s, uint32_t budget = no_distance);
+
+    // the distance to v from the last run, or no_distance if it is
+    // beyond the budget or cannot be reached
+    uint32_t distance(uint32_t v) const;
+
+    // the vertices reached by the last run, in no particular order
+    void reached(std::vector<uint32_t> &vertices) const;
+
+    uint32_t delta() const { return delta_; }
+    unsigned num_threads() const { return num_threads_; }
+
+private:
+    struct Worker;
+
+    void relax(Worker &worker, uint32_t v, uint32_t d);
+    // the rounds of a run, as thread t
+    void rounds(unsigned t);
+
+    const RoadMap &map_;
+    unsigned num_threads_;
+    uint32_t delta_;
+    uint32_t budget_;
+    std::unique_ptr<std::atomic<uint32_t>[]> dist_;
+    std::vector<std::unique_ptr<Worker>> workers_;
+
+    // threads 1 .. num_threads_-1, waiting on barrier_ for a run to start,
+    // or for stopping_ when the search is destroyed
+    std::unique_ptr<Barrier> barrier_;
+    std::vector<std::thread> threads_;
+    bool stopping_;
+    // the bucket of the current round, and whether the run is done
+    uint32_t current_;
+    bool done_;
+};
+
+/*
+    The convex hull of the vertices, as (lat, lon) corners in the same
+  fixed point as the map, counterclockwise from the westernmost (the
+  southernmost of those if there are several).
+  Fewer than three distinct positions give those positions.
+*/
+std::vector<std::pair<int32_t, int32_t>> convex_hull(const RoadMap &map,
+    const std::vector<uint32_t> &vertices);
+
+#endif
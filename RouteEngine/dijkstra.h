@@ -0,0 +1,199 @@
+/*
+ Dijkstra's algorithm on the road map, instantiated on a priority queue
+ from queues.h.
+
+ The queue type fixes the key (distance) type, and whether it supports
+ decrease key is checked with if constexpr, so each instantiation gets a
+ relaxation loop of its own with the queue calls inlined and no
+ virtual dispatch.  A Dijkstra object keeps its arrays between searches
+ and resets only what the last search touched, so repeated queries do
+ not pay for the size of the map.
+ */
+
+#ifndef DIJKSTRA_H
+#define DIJKSTRA_H
+
+#include <algorithm>
+#include <cstdint>
+#include <limits>
+#include <vector>
+
+#include "queues.h"
+#include "road_map.h"
+
+template <typename Queue>
+class Dijkstra {
+public:
+    typedef typename Queue::key_type Weight;
+    static constexpr Weight unreached = std::numeric_limits<Weight>::max();
+
+    explicit Dijkstra(const RoadMap &map)
+        : map_(map), dist_(map.num_vertices(), unreached),
+          parent_(map.num_vertices(), RoadMap::no_vertex),
+          target_(map.num_vertices(), 0),
+          queue_(map.num_vertices(), max_weight(map)) {}
+
+    /*
+        Search from s until t is settled, or until every vertex reachable
+      from s is if t is RoadMap::no_vertex.  Returns the distance to t, or
+      unreached.
+    */
+    Weight run(uint32_t s, uint32_t t = RoadMap::no_vertex) {
+        reset();
+        dist_[s] = 0;
+        touched_.push_back(s);
+        queue_.push(s, 0);
+        while (!queue_.empty()) {
+            auto [d, u] = queue_.pop();
+            if constexpr (!Queue::decrease_key) {
+                if (d > dist_[u]) {
+                    continue;
+                }
+            }
+            settled_++;
+            if (u == t) {
+                break;
+            }
+            relax(u, d);
+        }
+        return t == RoadMap::no_vertex ? 0 : dist_[t];
+    }
+
+    /*
+        Search from s until every vertex in targets is settled, or until
+      the next vertex to settle is further than budget, so a one to many
+      query costs one search however many targets it has.  Targets beyond
+      budget are left unreached.
+    */
+    void run(uint32_t s, const std::vector<uint32_t> &targets,
+            Weight budget = unreached) {
+        uint32_t left = 0;
+        for (uint32_t t : targets) {
+            if (!target_[t]) {
+                target_[t] = 1;
+                left++;
+            }
+        }
+        reset();
+        dist_[s] = 0;
+        touched_.push_back(s);
+        queue_.push(s, 0);
+        while (left > 0 && !queue_.empty()) {
+            auto [d, u] = queue_.pop();
+            if constexpr (!Queue::decrease_key) {
+                if (d > dist_[u]) {
+                    continue;
+                }
+            }
+            if (d > budget) {
+                break;
+            }
+            settled_++;
+            if (target_[u]) {
+                target_[u] = 0;
+                left--;
+            }
+            relax(u, d);
+        }
+        for (uint32_t t : targets) {
+            target_[t] = 0;
+            // a target reached but not settled may not have its shortest
+            // distance yet
+            if (dist_[t] > budget) {
+                dist_[t] = unreached;
+            }
+        }
+    }
+
+    /*
+        Search from s until the next vertex to settle is further than
+      budget, so every vertex within budget of s has its distance and the
+      rest are left unreached.
+    */
+    void run_within(uint32_t s, Weight budget) {
+        reset();
+        dist_[s] = 0;
+        touched_.push_back(s);
+        queue_.push(s, 0);
+        while (!queue_.empty()) {
+            auto [d, u] = queue_.pop();
+            if constexpr (!Queue::decrease_key) {
+                if (d > dist_[u]) {
+                    continue;
+                }
+            }
+            if (d > budget) {
+                break;
+            }
+            settled_++;
+            relax(u, d);
+        }
+        for (uint32_t v : touched_) {
+            if (dist_[v] > budget) {
+                dist_[v] = unreached;
+            }
+        }
+    }
+
+    // the distance to v found by the last run
+    Weight distance(uint32_t v) const { return dist_[v]; }
+
+    // the vertices settled by the last run
+    uint32_t settled() const { return settled_; }
+
+    // the path from the last run's source to t, empty if t was not reached
+    void path(uint32_t t, std::vector<uint32_t> &path) const {
+        path.clear();
+        if (dist_[t] == unreached) {
+            return;
+        }
+        for (uint32_t v = t; v != RoadMap::no_vertex; v = parent_[v]) {
+            path.push_back(v);
+        }
+        std::reverse(path.begin(), path.end());
+    }
+
+private:
+    static Weight max_weight(const RoadMap &map) {
+        uint32_t max = 0;
+        for (uint32_t w : map.weight) {
+            max = std::max(max, w);
+        }
+        return max;
+    }
+
+    void relax(uint32_t u, Weight d) {
+        for (uint32_t e = map_.first_out[u]; e < map_.first_out[u + 1]; e++) {
+            uint32_t w = map_.head[e];
+            Weight dw = d + (Weight) map_.weight[e];
+            if (dw < dist_[w]) {
+                if (dist_[w] == unreached) {
+                    touched_.push_back(w);
+                }
+                dist_[w] = dw;
+                parent_[w] = u;
+                queue_.push(w, dw);
+            }
+        }
+    }
+
+    void reset() {
+        for (uint32_t v : touched_) {
+            dist_[v] = unreached;
+            parent_[v] = RoadMap::no_vertex;
+        }
+        touched_.clear();
+        queue_.clear();
+        settled_ = 0;
+    }
+
+    const RoadMap &map_;
+    std::vector<Weight> dist_;
+    std::vector<uint32_t> parent_;
+    std::vector<uint32_t> touched_;
+    std::vector<uint8_t> target_;
+    Queue queue_;
+    uint32_t settled_ = 0;
+};
+
+#endif
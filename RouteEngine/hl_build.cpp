@@ -0,0 +1,45 @@
+/*
+ Build the hub labels of a road network text file.
+
+ Usage: hl_build <road file> <label file> [threads]
+ */
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <exception>
+
+#include "hub_labels.h"
+
+int main(int argc, char **argv) {
+    if (argc < 3) {
+        std::fprintf(stderr, "usage: %s <road file> <label file> [threads]\n",
+            argv[0]);
+        return 2;
+    }
+    unsigned threads = argc > 3 ? std::atoi(argv[3]) : 0;
+
+    try {
+        RoadMap map;
+        load_road_map(argv[1], map, threads);
+
+        auto start = std::chrono::steady_clock::now();
+        build_hub_labels(map, argv[2], threads);
+        double s = std::chrono::duration<double>(
+            std::chrono::steady_clock::now() - start).count();
+
+        HubLabels labels(argv[2]);
+        uint64_t entries = labels.num_entries();
+        std::printf("vertices %u\nedges %u\nbuild s %.1f\n"
+            "label entries %llu (%.1f per vertex per direction)\n"
+            "label bytes %llu\n",
+            map.num_vertices(), map.num_edges(), s,
+            (unsigned long long) entries,
+            entries / 2.0 / std::max(1u, map.num_vertices()),
+            (unsigned long long) labels.labels_size());
+    } catch (const std::exception &e) {
+        std::fprintf(stderr, "%s\n", e.what());
+        return 1;
+    }
+    return 0;
+}
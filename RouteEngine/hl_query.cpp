@@ -0,0 +1,121 @@
+/*
+ Time random distance queries against hub labels, and optionally check
+ them and the paths they give against plain Dijkstra.
+
+ Usage: hl_query <road file> <label file> [queries] [checks]
+ */
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <exception>
+#include <functional>
+#include <queue>
+#include <random>
+
+#include "hub_labels.h"
+
+// distance from s to t by Dijkstra, for checking
+static uint32_t dijkstra(const RoadMap &map, uint32_t s, uint32_t t) {
+    typedef std::pair<uint32_t, uint32_t> Item;
+    std::vector<uint32_t> dist(map.num_vertices(), no_distance);
+    std::priority_queue<Item, std::vector<Item>, std::greater<Item>> queue;
+    dist[s] = 0;
+    queue.push({0, s});
+    while (!queue.empty()) {
+        auto [d, u] = queue.top();
+        queue.pop();
+        if (u == t) {
+            return d;
+        }
+        if (d > dist[u]) {
+            continue;
+        }
+        for (uint32_t e = map.first_out[u]; e < map.first_out[u + 1]; e++) {
+            uint32_t w = map.head[e];
+            if (d + map.weight[e] < dist[w]) {
+                dist[w] = d + map.weight[e];
+                queue.push({dist[w], w});
+            }
+        }
+    }
+    return no_distance;
+}
+
+// the cost of path along the edges of map, or no_distance if it has a
+// step that is not an edge
+static uint32_t path_cost(const RoadMap &map, const std::vector<uint32_t> &path) {
+    uint32_t cost = 0;
+    for (size_t i = 1; i < path.size(); i++) {
+        uint32_t u = path[i - 1], e = map.first_out[u];
+        while (e < map.first_out[u + 1] && map.head[e] != path[i]) {
+            e++;
+        }
+        if (e == map.first_out[u + 1]) {
+            return no_distance;
+        }
+        cost += map.weight[e];
+    }
+    return cost;
+}
+
+int main(int argc, char **argv) {
+    if (argc < 3) {
+        std::fprintf(stderr,
+            "usage: %s <road file> <label file> [queries] [checks]\n", argv[0]);
+        return 2;
+    }
+    unsigned queries = argc > 3 ? std::atoi(argv[3]) : 1000000;
+    unsigned checks = argc > 4 ? std::atoi(argv[4]) : 0;
+
+    try {
+        RoadMap map;
+        load_road_map(argv[1], map);
+        HubLabels labels(argv[2]);
+        if (labels.num_vertices() != map.num_vertices()
+                || labels.num_edges() != map.num_edges()) {
+            std::fprintf(stderr, "%s was not built from %s\n", argv[2], argv[1]);
+            return 1;
+        }
+        uint32_t n = map.num_vertices();
+        std::mt19937 rng(1);
+
+        std::vector<std::pair<uint32_t, uint32_t>> pairs(queries);
+        for (auto &pair : pairs) {
+            pair = {rng() % n, rng() % n};
+        }
+        uint64_t sum = 0;
+        auto start = std::chrono::steady_clock::now();
+        for (auto &pair : pairs) {
+            sum += labels.distance(pair.first, pair.second);
+        }
+        double ns = std::chrono::duration<double, std::nano>(
+            std::chrono::steady_clock::now() - start).count();
+        std::printf("queries %u\nns per query %.0f\n(checksum %llu)\n",
+            queries, queries ? ns / queries : 0.0, (unsigned long long) sum);
+
+        unsigned bad = 0;
+        std::vector<uint32_t> path;
+        for (unsigned i = 0; i < checks; i++) {
+            uint32_t s = rng() % n, t = rng() % n;
+            uint32_t expect = dijkstra(map, s, t);
+            uint32_t got = labels.distance(s, t);
+            bool found = labels.path(map, s, t, path);
+            if (got != expect || found != (expect != no_distance)
+                    || (found && (path.front() != s || path.back() != t
+                        || path_cost(map, path) != expect))) {
+                if (bad++ < 10) {
+                    std::printf("mismatch %u -> %u: dijkstra %u labels %u\n",
+                        s, t, expect, got);
+                }
+            }
+        }
+        if (checks) {
+            std::printf("checked %u, %u wrong\n", checks, bad);
+        }
+        return bad ? 1 : 0;
+    } catch (const std::exception &e) {
+        std::fprintf(stderr, "%s\n", e.what());
+        return 1;
+    }
+}
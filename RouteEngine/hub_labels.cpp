@@ -0,0 +1,501 @@
+#include "hub_labels.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <functional>
+#include <queue>
+#include <random>
+#include <stdexcept>
+#include <string>
+#include <unordered_set>
+
+#include "parallel.h"
+
+/*
+    Pruned landmark labeling.
+
+    Vertices are ranked once up front: Dijkstra is run from a sample of
+    random roots and every vertex scores the size of its subtree in each
+    shortest path tree, so vertices that many shortest paths run through
+    (arterial roads, bridges) come first.  Hubs are then taken in rank
+    order.  For hub h a Dijkstra over the map gives every vertex v it
+    reaches the entry (h, d(h, v)) in its backward label, and one over the
+    reversed map gives (h, d(v, h)) in its forward label, except that the
+    search is pruned at any v whose distance is already answered by the
+    labels of earlier hubs.  Since the important hubs go first, most
+    searches die out within a few blocks.
+
+    Hubs are processed in batches, one hub per thread.  A search prunes
+    only against the labels of earlier batches, so the searches of a batch
+    are independent; the labels come out a little larger than building
+    one hub at a time but stay exact.
+*/
+
+const uint32_t hub_label_version = 1;
+
+namespace {
+
+const unsigned num_order_roots = 16;
+
+struct LabelEntry {
+    uint32_t rank;
+    uint32_t dist;
+};
+
+typedef std::vector<std::vector<LabelEntry>> Labels;
+
+// a graph as CSR arrays, for the reversed map
+struct Csr {
+    std::vector<uint32_t> first_out;
+    std::vector<uint32_t> head;
+    std::vector<uint32_t> weight;
+};
+
+Csr reverse_of(const RoadMap &map) {
+    uint32_t n = map.num_vertices();
+    Csr rev;
+    rev.first_out.assign(n + 1, 0);
+    for (uint32_t w : map.head) {
+        rev.first_out[w + 1]++;
+    }
+    for (uint32_t v = 0; v < n; v++) {
+        rev.first_out[v + 1] += rev.first_out[v];
+    }
+    rev.head.resize(map.num_edges());
+    rev.weight.resize(map.num_edges());
+    std::vector<uint32_t> next(rev.first_out.begin(), rev.first_out.end() - 1);
+    for (uint32_t u = 0; u < n; u++) {
+        for (uint32_t e = map.first_out[u]; e < map.first_out[u + 1]; e++) {
+            uint32_t slot = next[map.head[e]]++;
+            rev.head[slot] = u;
+            rev.weight[slot] = map.weight[e];
+        }
+    }
+    return rev;
+}
+
+typedef std::pair<uint32_t, uint32_t> QueueItem;    // (distance, vertex)
+typedef std::priority_queue<QueueItem, std::vector<QueueItem>,
+    std::greater<QueueItem>> MinQueue;
+
+/*
+    Rank the vertices, most important first, by their summed subtree sizes
+  in the shortest path trees of a few random roots, breaking ties by
+  degree.  Returns the vertex of each rank.
+*/
+std::vector<uint32_t> vertex_order(const RoadMap &map, unsigned num_threads) {
+    uint32_t n = map.num_vertices();
+    unsigned roots = std::min<uint32_t>(num_order_roots, n);
+    std::vector<std::vector<uint64_t>> scores(roots);
+
+    parallel_for(roots, num_threads, [&](size_t r) {
+        std::mt19937 rng(r + 1);
+        uint32_t root = rng() % n;
+
+        std::vector<uint32_t> dist(n, no_distance), parent(n, n);
+        std::vector<uint32_t> settled;
+        MinQueue queue;
+        dist[root] = 0;
+        queue.push({0, root});
+        while (!queue.empty()) {
+            auto [d, u] = queue.top();
+            queue.pop();
+            if (d > dist[u]) {
+                continue;
+            }
+            settled.push_back(u);
+            for (uint32_t e = map.first_out[u]; e < map.first_out[u + 1]; e++) {
+                uint32_t w = map.head[e];
+                if (d + map.weight[e] < dist[w]) {
+                    dist[w] = d + map.weight[e];
+                    parent[w] = u;
+                    queue.push({dist[w], w});
+                }
+            }
+        }
+
+        // children are settled after their parents, so a reverse sweep
+        // adds each finished subtree into its parent
+        std::vector<uint64_t> &size = scores[r];
+        size.assign(n, 0);
+        for (auto it = settled.rbegin(); it != settled.rend(); ++it) {
+            size[*it]++;
+            if (parent[*it] != n) {
+                size[parent[*it]] += size[*it];
+            }
+        }
+    });
+
+    std::vector<uint64_t> score(n, 0);
+    for (auto &size : scores) {
+        for (uint32_t v = 0; v < n; v++) {
+            score[v] += size[v];
+        }
+    }
+
+    std::vector<uint32_t> order(n);
+    for (uint32_t v = 0; v < n; v++) {
+        order[v] = v;
+    }
+    std::sort(order.begin(), order.end(), [&](uint32_t a, uint32_t b) {
+        if (score[a] != score[b]) {
+            return score[a] > score[b];
+        }
+        uint32_t deg_a = map.first_out[a + 1] - map.first_out[a];
+        uint32_t deg_b = map.first_out[b + 1] - map.first_out[b];
+        if (deg_a != deg_b) {
+            return deg_a > deg_b;
+        }
+        return a < b;
+    });
+    return order;
+}
+
+// the scratch space of one thread's pruned searches
+struct Searcher {
+    std::vector<uint32_t> dist;         // per vertex
+    std::vector<uint32_t> hub_dist;     // per rank, the label of the hub
+    std::vector<uint32_t> touched;
+    MinQueue queue;
+
+    // (vertex, entry) found by the searches of the current batch
+    std::vector<std::pair<uint32_t, LabelEntry>> found;
+
+    explicit Searcher(uint32_t n) : dist(n, no_distance), hub_dist(n, no_distance) {}
+
+    /*
+        Search from hub, of rank rank, over the graph first_out/head/weight.
+      from_hub is the hub's own label in the opposite direction, to_labels
+      the labels being grown, both as of the last batch.
+    */
+    void search(uint32_t hub, uint32_t rank,
+            const std::vector<uint32_t> &first_out,
+            const std::vector<uint32_t> &head,
+            const std::vector<uint32_t> &weight,
+            const std::vector<LabelEntry> &from_hub, const Labels &to_labels) {
+        for (const LabelEntry &entry : from_hub) {
+            hub_dist[entry.rank] = entry.dist;
+        }
+
+        dist[hub] = 0;
+        touched.push_back(hub);
+        queue.push({0, hub});
+        while (!queue.empty()) {
+            auto [d, u] = queue.top();
+            queue.pop();
+            if (d > dist[u]) {
+                continue;
+            }
+
+            bool covered = false;
+            for (const LabelEntry &entry : to_labels[u]) {
+                uint32_t via = hub_dist[entry.rank];
+                if (via != no_distance && via + entry.dist <= d) {
+                    covered = true;
+                    break;
+                }
+            }
+            if (covered) {
+                continue;
+            }
+
+            found.push_back({u, {rank, d}});
+            for (uint32_t e = first_out[u]; e < first_out[u + 1]; e++) {
+                uint32_t w = head[e];
+                if (d + weight[e] < dist[w]) {
+                    if (dist[w] == no_distance) {
+                        touched.push_back(w);
+                    }
+                    dist[w] = d + weight[e];
+                    queue.push({dist[w], w});
+                }
+            }
+        }
+
+        for (uint32_t v : touched) {
+            dist[v] = no_distance;
+        }
+        touched.clear();
+        for (const LabelEntry &entry : from_hub) {
+            hub_dist[entry.rank] = no_distance;
+        }
+    }
+};
+
+// append the entries the searchers found in a batch to labels, keeping
+// the ranks of each label increasing
+void merge_found(std::vector<Searcher> &searchers, Labels &labels) {
+    std::vector<std::pair<uint32_t, LabelEntry>> all;
+    for (Searcher &searcher : searchers) {
+        all.insert(all.end(), searcher.found.begin(), searcher.found.end());
+        searcher.found.clear();
+    }
+    std::sort(all.begin(), all.end(), [](const auto &a, const auto &b) {
+        if (a.first != b.first) {
+            return a.first < b.first;
+        }
+        return a.second.rank < b.second.rank;
+    });
+    for (const auto &item : all) {
+        labels[item.first].push_back(item.second);
+    }
+}
+
+void put_varint(std::vector<uint8_t> &out, uint32_t value) {
+    while (value >= 0x80) {
+        out.push_back((uint8_t) (value | 0x80));
+        value >>= 7;
+    }
+    out.push_back((uint8_t) value);
+}
+
+inline uint32_t get_varint(const uint8_t *&p) {
+    uint32_t value = *p & 0x7f;
+    unsigned shift = 7;
+    while (*p++ & 0x80) {
+        value |= (uint32_t) (*p & 0x7f) << shift;
+        shift += 7;
+    }
+    return value;
+}
+
+// encode labels into bytes, with the offset of each vertex's label
+void encode_labels(const Labels &labels, std::vector<uint8_t> &bytes,
+        std::vector<uint64_t> &offset) {
+    offset.clear();
+    for (const auto &label : labels) {
+        offset.push_back(bytes.size());
+        uint32_t prev = 0;
+        for (const LabelEntry &entry : label) {
+            put_varint(bytes, entry.rank - prev);
+            put_varint(bytes, entry.dist);
+            prev = entry.rank;
+        }
+    }
+    offset.push_back(bytes.size());
+}
+
+// true if the num_vertices + 1 offsets never go down or past size, and
+// every label ends with the last byte of a varint
+bool offsets_valid(const uint64_t *offset, uint64_t num_vertices,
+        const uint8_t *labels, uint64_t size) {
+    if (offset[0] > size) {
+        return false;
+    }
+    for (uint64_t v = 0; v < num_vertices; v++) {
+        if (offset[v + 1] < offset[v] || offset[v + 1] > size) {
+            return false;
+        }
+        if (offset[v + 1] > offset[v] && (labels[offset[v + 1] - 1] & 0x80)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+void write_all(FILE *out, const void *data, size_t size, const char *path) {
+    if (size > 0 && std::fwrite(data, 1, size, out) != size) {
+        std::fclose(out);
+        throw std::runtime_error(std::string("cannot write ") + path);
+    }
+}
+
+} // namespace
+
+void build_hub_labels(const RoadMap &map, const char *out_path,
+        unsigned num_threads) {
+    num_threads = default_threads(num_threads);
+    uint32_t n = map.num_vertices();
+
+    std::vector<uint32_t> order = vertex_order(map, num_threads);
+    Csr rev = reverse_of(map);
+
+    Labels forward(n), backward(n);
+    std::vector<Searcher> fwd_searchers, bwd_searchers;
+    for (unsigned t = 0; t < num_threads; t++) {
+        fwd_searchers.emplace_back(n);
+        bwd_searchers.emplace_back(n);
+    }
+
+    // The threads are started once and kept together by a barrier: each
+    // searches from one hub of a batch, then the searches are merged into
+    // the labels, forward and backward at once, before the next batch
+    // reads them.
+    Barrier barrier(num_threads);
+    parallel_for(num_threads, num_threads, [&](size_t t) {
+        for (uint32_t batch = 0; batch < n; batch += num_threads) {
+            uint32_t rank = batch + t;
+            if (rank < n) {
+                uint32_t hub = order[rank];
+                // searching the map from the hub finds d(hub, v), which
+                // goes in the backward label of v, pruned by forward(hub)
+                fwd_searchers[t].search(hub, rank, map.first_out, map.head,
+                    map.weight, forward[hub], backward);
+                bwd_searchers[t].search(hub, rank, rev.first_out, rev.head,
+                    rev.weight, backward[hub], forward);
+            }
+            barrier.wait();
+            if (t == 0) {
+                merge_found(fwd_searchers, backward);
+            }
+            if (t == (num_threads > 1 ? 1 : 0)) {
+                merge_found(bwd_searchers, forward);
+            }
+            barrier.wait();
+        }
+    });
+
+    std::vector<uint8_t> bytes;
+    std::vector<uint64_t> forward_offset, backward_offset;
+    encode_labels(forward, bytes, forward_offset);
+    Labels().swap(forward);
+    encode_labels(backward, bytes, backward_offset);
+
+    HubLabelHeader header;
+    std::memcpy(header.magic, "HLAB", 4);
+    header.version = hub_label_version;
+    header.num_vertices = n;
+    header.num_edges = map.num_edges();
+    header.labels_size = bytes.size();
+
+    FILE *out = std::fopen(out_path, "wb");
+    if (!out) {
+        throw std::runtime_error(std::string("cannot create ") + out_path);
+    }
+    write_all(out, &header, sizeof(header), out_path);
+    write_all(out, forward_offset.data(), forward_offset.size() * 8, out_path);
+    write_all(out, backward_offset.data(), backward_offset.size() * 8, out_path);
+    write_all(out, bytes.data(), bytes.size(), out_path);
+    if (std::fclose(out) != 0) {
+        throw std::runtime_error(std::string("cannot write ") + out_path);
+    }
+}
+
+// queries touch labels all over the file
+HubLabels::HubLabels(const char *path) : file_(path, MADV_RANDOM) {
+    const uint8_t *data = (const uint8_t *) file_.data;
+    size_t size = file_.size;
+    if (size < sizeof(HubLabelHeader)) {
+        throw std::runtime_error(std::string("not a hub label file: ") + path);
+    }
+
+    header_ = (const HubLabelHeader *) data;
+    uint64_t n = header_->num_vertices;
+    size_t offsets_end = sizeof(HubLabelHeader) + 2 * (n + 1) * 8;
+    if (std::memcmp(header_->magic, "HLAB", 4) != 0
+            || header_->version != hub_label_version
+            || offsets_end > size
+            || header_->labels_size != size - offsets_end) {
+        throw std::runtime_error(std::string("not a hub label file: ") + path);
+    }
+    forward_offset_ = (const uint64_t *) (data + sizeof(HubLabelHeader));
+    backward_offset_ = forward_offset_ + n + 1;
+    labels_ = data + offsets_end;
+
+    // queries index the labels with the offsets unchecked, so a corrupt
+    // file must be caught here
+    if (!offsets_valid(forward_offset_, n, labels_, header_->labels_size)
+            || !offsets_valid(backward_offset_, n, labels_,
+                header_->labels_size)) {
+        throw std::runtime_error(std::string("corrupt hub label file: ")
+            + path);
+    }
+}
+
+const uint8_t *HubLabels::label(const uint64_t *offset, uint32_t v,
+        const uint8_t **end) const {
+    *end = labels_ + offset[v + 1];
+    return labels_ + offset[v];
+}
+
+uint32_t HubLabels::distance(uint32_t s, uint32_t t) const {
+    const uint8_t *a_end, *b_end;
+    const uint8_t *a = label(forward_offset_, s, &a_end);
+    const uint8_t *b = label(backward_offset_, t, &b_end);
+    if (a == a_end || b == b_end) {
+        return no_distance;
+    }
+
+    // merge the two rank sorted lists, decoding as we go
+    uint64_t best = no_distance;
+    uint32_t a_rank = get_varint(a), a_dist = get_varint(a);
+    uint32_t b_rank = get_varint(b), b_dist = get_varint(b);
+    while (true) {
+        if (a_rank == b_rank) {
+            best = std::min(best, (uint64_t) a_dist + b_dist);
+            if (a == a_end || b == b_end) {
+                break;
+            }
+            a_rank += get_varint(a);
+            a_dist = get_varint(a);
+            b_rank += get_varint(b);
+            b_dist = get_varint(b);
+        } else if (a_rank < b_rank) {
+            if (a == a_end) {
+                break;
+            }
+            a_rank += get_varint(a);
+            a_dist = get_varint(a);
+        } else {
+            if (b == b_end) {
+                break;
+            }
+            b_rank += get_varint(b);
+            b_dist = get_varint(b);
+        }
+    }
+    return (uint32_t) best;
+}
+
+bool HubLabels::path(const RoadMap &map, uint32_t s, uint32_t t,
+        std::vector<uint32_t> &path) const {
+    path.clear();
+    uint32_t left = distance(s, t);
+    if (left == no_distance) {
+        return false;
+    }
+
+    // zero length edges join vertices at the same spot, so a vertex can
+    // look like the next step from its twin; never go back
+    std::unordered_set<uint32_t> visited;
+    uint32_t u = s;
+    path.push_back(u);
+    visited.insert(u);
+    while (u != t) {
+        uint32_t next = RoadMap::no_vertex, cost = 0;
+        for (uint32_t e = map.first_out[u]; e < map.first_out[u + 1]; e++) {
+            uint32_t w = map.head[e];
+            if (map.weight[e] > left || visited.count(w)) {
+                continue;
+            }
+            if (distance(w, t) == left - map.weight[e]) {
+                next = w;
+                cost = map.weight[e];
+                break;
+            }
+        }
+        if (next == RoadMap::no_vertex) {
+            // the labels do not match the map
+            path.clear();
+            return false;
+        }
+        left -= cost;
+        u = next;
+        path.push_back(u);
+        visited.insert(u);
+    }
+    return true;
+}
+
+uint64_t HubLabels::num_entries() const {
+    uint64_t entries = 0;
+    const uint8_t *p = labels_, *end = labels_ + header_->labels_size;
+    for (; p < end; p++) {
+        if (!(*p & 0x80)) {
+            entries++;
+        }
+    }
+    // every entry is two varints
+    return entries / 2;
+}
@@ -0,0 +1,98 @@
+/*
+ Hub labels for exact shortest path distances on the road map.
+
+ Every vertex v gets a forward label, the hubs h it can reach with the
+ distance d(v, h), and a backward label, the hubs that reach it with
+ d(h, v), chosen (by pruned landmark labeling) so that every shortest
+ path from s to t passes through a hub in both the forward label of s
+ and the backward label of t.  The distance from s to t is then the
+ smallest d(s, h) + d(h, t) over the hubs the two labels share, which is
+ a merge of two short sorted lists instead of a graph search.
+
+ Labels are built offline by build_hub_labels and written to a file that
+ HubLabels maps read only, so any number of server processes share one
+ copy and start instantly.
+ */
+
+#ifndef HUB_LABELS_H
+#define HUB_LABELS_H
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include "parallel.h"
+#include "road_map.h"
+
+/*
+    Build the hub labels of map and write them to out_path, using up to
+  num_threads threads (0 picks one per core).  Throws std::runtime_error if
+  the file cannot be written.
+*/
+void build_hub_labels(const RoadMap &map, const char *out_path,
+    unsigned num_threads = 0);
+
+/*
+    Hub labels read from a file written by build_hub_labels.
+
+    The file is laid out, all integers little-endian, as
+        header          HubLabelHeader
+        forward_offset  uint64_t per vertex, and one past the last
+        backward_offset uint64_t per vertex, and one past the last
+        labels          the encoded labels
+    where the label of a vertex is the byte range of the labels section
+    from its offset to the next.  Each label lists its hubs by increasing
+    rank as pairs of LEB128 varints: the rank less the previous rank, and
+    the distance.  Ranks are positions in the order the hubs were picked,
+    most important first.
+*/
+struct HubLabelHeader {
+    char magic[4];             // "HLAB"
+    uint32_t version;          // hub_label_version
+    uint32_t num_vertices;
+    uint32_t num_edges;        // of the map, to catch a mismatched map
+    uint64_t labels_size;      // bytes in the labels section
+};
+
+extern const uint32_t hub_label_version;
+
+class HubLabels {
+public:
+    // Map the labels at path.  Throws std::runtime_error if it cannot be
+    // read or is not a hub label file.
+    explicit HubLabels(const char *path);
+
+    HubLabels(const HubLabels &) = delete;
+    HubLabels &operator=(const HubLabels &) = delete;
+
+    uint32_t num_vertices() const { return header_->num_vertices; }
+    uint32_t num_edges() const { return header_->num_edges; }
+
+    // the shortest path distance from s to t, or no_distance
+    uint32_t distance(uint32_t s, uint32_t t) const;
+
+    /*
+        The vertices of a shortest path from s to t, walking from s along
+      edges of map that keep to a shortest path according to the labels.
+      map must be the map the labels were built from.  Returns false, and
+      leaves path empty, if t cannot be reached from s.
+    */
+    bool path(const RoadMap &map, uint32_t s, uint32_t t,
+        std::vector<uint32_t> &path) const;
+
+    // total bytes used by the labels, and the number of label entries
+    uint64_t labels_size() const { return header_->labels_size; }
+    uint64_t num_entries() const;
+
+private:
+    const uint8_t *label(const uint64_t *offset, uint32_t v,
+        const uint8_t **end) const;
+
+    MappedFile file_;
+    const HubLabelHeader *header_;
+    const uint64_t *forward_offset_;
+    const uint64_t *backward_offset_;
+    const uint8_t *labels_;
+};
+
+#endif
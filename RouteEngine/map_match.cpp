@@ -0,0 +1,392 @@
+#include "map_match.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <limits>
+#include <thread>
+
+#include "dijkstra.h"
+#include "parallel.h"
+
+namespace {
+
+const double impossible = -std::numeric_limits<double>::infinity();
+const uint32_t no_candidate = UINT32_MAX;
+
+// cells the grid may have per edge before its cells are made larger
+const uint64_t max_cells_per_edge = 4;
+
+double straight_distance(double lat1, double lon1, double lat2, double lon2) {
+    double dlat = lat2 - lat1;
+    double dlon = lon2 - lon1;
+    return std::sqrt(dlat * dlat + dlon * dlon);
+}
+
+// append v to path unless it is already the last vertex
+void append_vertex(std::vector<uint32_t> &path, uint32_t v) {
+    if (path.empty() || path.back() != v) {
+        path.push_back(v);
+    }
+}
+
+} // namespace
+
+EdgeGrid::EdgeGrid(const RoadMap &map, uint32_t cell_size)
+    : map_(map), cell_size_(std::max(1u, cell_size)), min_lat_(0),
+      min_lon_(0), rows_(1), cols_(1) {
+    uint32_t n = map.num_vertices();
+    tail_.resize(map.num_edges());
+    for (uint32_t u = 0; u < n; u++) {
+        for (uint32_t e = map.first_out[u]; e < map.first_out[u + 1]; e++) {
+            tail_[e] = u;
+        }
+    }
+
+    if (n > 0) {
+        min_lat_ = *std::min_element(map.lat.begin(), map.lat.end());
+        min_lon_ = *std::min_element(map.lon.begin(), map.lon.end());
+        int64_t lat_span = (int64_t) *std::max_element(map.lat.begin(),
+            map.lat.end()) - min_lat_;
+        int64_t lon_span = (int64_t) *std::max_element(map.lon.begin(),
+            map.lon.end()) - min_lon_;
+        // a sparse map over a wide area would otherwise be mostly empty
+        // cells
+        uint64_t max_cells = max_cells_per_edge * map.num_edges() + 1;
+        while (true) {
+            rows_ = (uint32_t) (lat_span / cell_size_ + 1);
+            cols_ = (uint32_t) (lon_span / cell_size_ + 1);
+            if ((uint64_t) rows_ * cols_ <= max_cells) {
+                break;
+            }
+            cell_size_ *= 2;
+        }
+    }
+
+    // each edge goes in every cell its bounding box overlaps; count them,
+    // then fill them in
+    auto for_cells = [&](uint32_t e, auto body) {
+        int32_t lat1 = map.lat[tail_[e]];
+        int32_t lat2 = map.lat[map.head[e]];
+        int32_t lon1 = map.lon[tail_[e]];
+        int32_t lon2 = map.lon[map.head[e]];
+        uint32_t r1 = ((int64_t) std::min(lat1, lat2) - min_lat_) / cell_size_;
+        uint32_t r2 = ((int64_t) std::max(lat1, lat2) - min_lat_) / cell_size_;
+        uint32_t c1 = ((int64_t) std::min(lon1, lon2) - min_lon_) / cell_size_;
+        uint32_t c2 = ((int64_t) std::max(lon1, lon2) - min_lon_) / cell_size_;
+        for (uint32_t r = r1; r <= r2; r++) {
+            for (uint32_t c = c1; c <= c2; c++) {
+                body((size_t) r * cols_ + c);
+            }
+        }
+    };
+
+    cell_first_.assign((size_t) rows_ * cols_ + 1, 0);
+    for (uint32_t e = 0; e < map.num_edges(); e++) {
+        for_cells(e, [&](size_t cell) { cell_first_[cell + 1]++; });
+    }
+    for (size_t cell = 0; cell + 1 < cell_first_.size(); cell++) {
+        cell_first_[cell + 1] += cell_first_[cell];
+    }
+    cell_edges_.resize(cell_first_.back());
+    std::vector<uint32_t> fill(cell_first_.begin(), cell_first_.end() - 1);
+    for (uint32_t e = 0; e < map.num_edges(); e++) {
+        for_cells(e, [&](size_t cell) { cell_edges_[fill[cell]++] = e; });
+    }
+}
+
+void EdgeGrid::near(int32_t lat, int32_t lon, double radius,
+        std::vector<Near> &found) const {
+    found.clear();
+    if (map_.num_edges() == 0) {
+        return;
+    }
+
+    auto clamp_index = [](double i, uint32_t size) {
+        return (uint32_t) std::min(std::max(i, 0.0), (double) size - 1);
+    };
+    uint32_t r1 = clamp_index(std::floor((lat - radius - min_lat_) / cell_size_),
+        rows_);
+    uint32_t r2 = clamp_index(std::floor((lat + radius - min_lat_) / cell_size_),
+        rows_);
+    uint32_t c1 = clamp_index(std::floor((lon - radius - min_lon_) / cell_size_),
+        cols_);
+    uint32_t c2 = clamp_index(std::floor((lon + radius - min_lon_) / cell_size_),
+        cols_);
+
+    for (uint32_t r = r1; r <= r2; r++) {
+        for (uint32_t c = c1; c <= c2; c++) {
+            size_t cell = (size_t) r * cols_ + c;
+            for (uint32_t i = cell_first_[cell]; i < cell_first_[cell + 1];
+                    i++) {
+                uint32_t e = cell_edges_[i];
+                // the point on the segment nearest (lat, lon)
+                double lat1 = map_.lat[tail_[e]];
+                double lon1 = map_.lon[tail_[e]];
+                double dlat = map_.lat[map_.head[e]] - lat1;
+                double dlon = map_.lon[map_.head[e]] - lon1;
+                double length2 = dlat * dlat + dlon * dlon;
+                double t = 0;
+                if (length2 > 0) {
+                    t = ((lat - lat1) * dlat + (lon - lon1) * dlon) / length2;
+                    t = std::min(std::max(t, 0.0), 1.0);
+                }
+                double d = straight_distance(lat, lon, lat1 + t * dlat,
+                    lon1 + t * dlon);
+                if (d <= radius) {
+                    found.push_back({e, d, t});
+                }
+            }
+        }
+    }
+
+    // an edge across several cells was found in each of them
+    std::sort(found.begin(), found.end(), [](const Near &a, const Near &b) {
+        return a.edge < b.edge;
+    });
+    found.erase(std::unique(found.begin(), found.end(),
+        [](const Near &a, const Near &b) { return a.edge == b.edge; }),
+        found.end());
+    std::sort(found.begin(), found.end(), [](const Near &a, const Near &b) {
+        return a.distance < b.distance;
+    });
+}
+
+struct MapMatcher::Search {
+    explicit Search(const RoadMap &map) : dijkstra(map) {}
+
+    Dijkstra<RadixHeap<uint32_t>> dijkstra;
+    std::vector<uint32_t> targets;
+    std::vector<uint32_t> route;
+};
+
+struct MapMatcher::Candidate {
+    uint32_t edge;
+    uint32_t tail;
+    uint32_t head;
+    double fraction;    // where on the edge the point was matched
+    double emission;    // log likelihood of the fix given this candidate
+    double score;       // log likelihood of the best match ending here
+    uint32_t parent;    // the candidate before on that match, or
+                        // no_candidate if the match starts here
+    bool along;         // whether that match reaches it along the parent's
+                        // edge rather than through the head of that edge
+};
+
+MapMatcher::MapMatcher(const RoadMap &map, const EdgeGrid &grid,
+        const MatchOptions &options)
+    : map_(map), grid_(grid), options_(options),
+      search_(new Search(map)) {}
+
+MapMatcher::~MapMatcher() {}
+
+void MapMatcher::candidates(const GpsPoint &point,
+        std::vector<Candidate> &found) {
+    grid_.near(point.lat, point.lon, options_.radius, near_);
+    if (near_.size() > options_.max_candidates) {
+        near_.resize(options_.max_candidates);
+    }
+    found.clear();
+    for (const EdgeGrid::Near &n : near_) {
+        double z = n.distance / options_.sigma;
+        found.push_back({n.edge, grid_.tail(n.edge), map_.head[n.edge],
+            n.fraction, -0.5 * z * z, impossible, no_candidate, false});
+    }
+}
+
+/*
+    Score the candidates of to_point by the best way to reach each from
+  the candidates of from_point, leaving them impossible if none can.
+*/
+void MapMatcher::transitions(const GpsPoint &from_point,
+        const GpsPoint &to_point, const std::vector<Candidate> &from,
+        std::vector<Candidate> &to) {
+    double straight = straight_distance(from_point.lat, from_point.lon,
+        to_point.lat, to_point.lon);
+    double budget = straight * options_.max_detour + 2 * options_.radius;
+    auto transition = [&](const Candidate &a, uint32_t ia, Candidate &b,
+            double route, bool along) {
+        if (route > budget) {
+            return;
+        }
+        double score = a.score + b.emission
+            - std::fabs(route - straight) / options_.beta;
+        if (score > b.score) {
+            b.score = score;
+            b.parent = ia;
+            b.along = along;
+        }
+    };
+
+    // moving along one edge needs no search
+    for (uint32_t ia = 0; ia < from.size(); ia++) {
+        for (Candidate &b : to) {
+            if (b.edge == from[ia].edge && b.fraction >= from[ia].fraction) {
+                transition(from[ia], ia, b, (b.fraction - from[ia].fraction)
+                    * map_.weight[b.edge], true);
+            }
+        }
+    }
+
+    // otherwise the route leaves a's edge at its head and joins b's at its
+    // tail, and one search from each head reaches every tail; this holds
+    // for b on a's own edge too, by a route around back to its tail
+    Search &search = *search_;
+    search.targets.clear();
+    for (const Candidate &b : to) {
+        search.targets.push_back(b.tail);
+    }
+    for (uint32_t ia = 0; ia < from.size(); ia++) {
+        const Candidate &a = from[ia];
+        if (a.score == impossible) {
+            continue;
+        }
+        bool searched = false;
+        for (uint32_t j = 0; j < ia; j++) {
+            if (from[j].head == a.head && from[j].score != impossible) {
+                searched = true;
+            }
+        }
+        // candidates sharing a head are scored together by the first
+        if (searched) {
+            continue;
+        }
+        search.dijkstra.run(a.head, search.targets, (uint32_t) budget);
+        for (uint32_t ja = ia; ja < from.size(); ja++) {
+            const Candidate &a2 = from[ja];
+            if (a2.head != a.head || a2.score == impossible) {
+                continue;
+            }
+            double leave = (1 - a2.fraction) * map_.weight[a2.edge];
+            for (Candidate &b : to) {
+                uint32_t d = search.dijkstra.distance(b.tail);
+                if (d != search.dijkstra.unreached) {
+                    transition(a2, ja, b,
+                        leave + d + b.fraction * map_.weight[b.edge], false);
+                }
+            }
+        }
+    }
+}
+
+/*
+    Append the vertices from the edge of from to the edge of to, which a
+  transition scored as reachable.
+
+    The route is searched for again rather than kept from transitions,
+  whose search trees are overwritten by the next point's and would take a
+  parent array each to keep for the whole trace.  This search is from one
+  head to one tail known to be within the transition budget, and stops
+  once that tail is settled; most fixes move along one edge and need none.
+*/
+void MapMatcher::append_route(const Candidate &from, const Candidate &to,
+        MatchResult &result) {
+    if (to.along) {
+        return;
+    }
+    Search &search = *search_;
+    search.dijkstra.run(from.head, to.tail);
+    search.dijkstra.path(to.tail, search.route);
+    for (uint32_t v : search.route) {
+        append_vertex(result.path, v);
+    }
+    append_vertex(result.path, to.head);
+}
+
+void MapMatcher::match(const std::vector<GpsPoint> &trace,
+        MatchResult &result) {
+    result.path.clear();
+    result.edges.assign(trace.size(), (uint32_t) RoadMap::no_vertex);
+    result.breaks = 0;
+
+    // the candidates of each point that has some, and which point that is
+    std::vector<std::vector<Candidate>> layers;
+    std::vector<uint32_t> layer_point;
+    for (uint32_t i = 0; i < trace.size(); i++) {
+        layers.emplace_back();
+        candidates(trace[i], layers.back());
+        if (layers.back().empty()) {
+            layers.pop_back();
+            continue;
+        }
+        std::vector<Candidate> &to = layers.back();
+        if (layers.size() > 1) {
+            transitions(trace[layer_point.back()], trace[i],
+                layers[layers.size() - 2], to);
+        }
+        bool reached = false;
+        for (const Candidate &b : to) {
+            reached = reached || b.score != impossible;
+        }
+        if (!reached) {
+            // the first point, or no route from the point before: start
+            // matching again from here
+            if (layers.size() > 1) {
+                result.breaks++;
+            }
+            for (Candidate &b : to) {
+                b.score = b.emission;
+            }
+        }
+        layer_point.push_back(i);
+    }
+    if (layers.empty()) {
+        return;
+    }
+
+    // follow the best match back from its end, and where it started again
+    // after a break, the best match that ended before the break
+    auto best = [&](const std::vector<Candidate> &layer) {
+        uint32_t top = 0;
+        for (uint32_t j = 1; j < layer.size(); j++) {
+            if (layer[j].score > layer[top].score) {
+                top = j;
+            }
+        }
+        return top;
+    };
+    std::vector<uint32_t> chosen(layers.size());
+    uint32_t current = best(layers.back());
+    for (size_t l = layers.size(); l-- > 0; ) {
+        chosen[l] = current;
+        uint32_t parent = layers[l][current].parent;
+        if (l > 0) {
+            current = parent != no_candidate ? parent : best(layers[l - 1]);
+        }
+    }
+
+    for (size_t l = 0; l < layers.size(); l++) {
+        const Candidate &c = layers[l][chosen[l]];
+        result.edges[layer_point[l]] = c.edge;
+        if (l > 0 && c.parent != no_candidate) {
+            append_route(layers[l - 1][chosen[l - 1]], c, result);
+        } else {
+            append_vertex(result.path, c.tail);
+            append_vertex(result.path, c.head);
+        }
+    }
+}
+
+void match_traces(const RoadMap &map, const EdgeGrid &grid,
+        const std::vector<std::vector<GpsPoint>> &traces,
+        std::vector<MatchResult> &results, const MatchOptions &options,
+        unsigned num_threads) {
+    num_threads = default_threads(num_threads);
+    results.resize(traces.size());
+
+    // traces differ in length, so threads take them one at a time rather
+    // than in equal blocks
+    std::atomic<size_t> next{0};
+    std::vector<std::thread> threads;
+    for (unsigned t = 0; t < num_threads; t++) {
+        threads.emplace_back([&] {
+            MapMatcher matcher(map, grid, options);
+            for (size_t i; (i = next.fetch_add(1)) < traces.size(); ) {
+                matcher.match(traces[i], results[i]);
+            }
+        });
+    }
+    for (auto &thread : threads) {
+        thread.join();
+    }
+}
@@ -0,0 +1,154 @@
+/*
+ Map matching of GPS traces onto the road map with a hidden Markov
+ model, after Newson and Krumm.
+
+ Each point of a trace has as candidates the road edges within a radius
+ of it, each at the point on the edge nearest the fix.  A candidate is
+ likely in proportion to a Gaussian in its distance from the fix, and a
+ move from a candidate of one point to a candidate of the next is likely
+ in proportion to an exponential in how much the route between them
+ differs from the straight line between the fixes.  The most likely
+ sequence of candidates is found with the Viterbi algorithm, and the
+ vertex path follows from the routes between them.
+
+ Candidates come from a uniform grid over the edges rather than a scan
+ of the map, and the routes from one candidate to all the candidates of
+ the next point are one bounded Dijkstra search per distinct edge end,
+ however many candidates there are.  Traces are independent, so a batch
+ is shared out over threads, each with a matcher of its own.
+ */
+
+#ifndef MAP_MATCH_H
+#define MAP_MATCH_H
+
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+#include "road_map.h"
+
+/*
+    The edges of the map bucketed into square grid cells, so the edges
+  near a point are found by looking at the cells around it.  Edges are
+  numbered as in the CSR arrays of the map.
+*/
+class EdgeGrid {
+public:
+    // Index the edges of map in cells cell_size fixed point units wide.
+    EdgeGrid(const RoadMap &map, uint32_t cell_size);
+
+    struct Near {
+        uint32_t edge;
+        double distance;    // from the point to the edge
+        double fraction;    // where on the edge the nearest point is, 0..1
+    };
+
+    // the edges within radius of (lat, lon), each once, nearest first
+    void near(int32_t lat, int32_t lon, double radius,
+        std::vector<Near> &found) const;
+
+    // the vertex edge e leaves from
+    uint32_t tail(uint32_t e) const { return tail_[e]; }
+
+private:
+    const RoadMap &map_;
+    uint32_t cell_size_;
+    int32_t min_lat_;
+    int32_t min_lon_;
+    uint32_t rows_;
+    uint32_t cols_;
+
+    // the edges of cell r * cols_ + c are
+    // cell_edges_[cell_first_[cell] .. cell_first_[cell+1])
+    std::vector<uint32_t> cell_first_;
+    std::vector<uint32_t> cell_edges_;
+    std::vector<uint32_t> tail_;
+};
+
+/*
+    Fixed point units in a metre east to west at the latitude of Edmonton,
+  53.5 degrees north, where 1e-5 degree of longitude is 0.66 m.  North to
+  south a unit is 1.11 m, so a distance of d metres taken as
+  d * units_per_metre units is at least d metres in every direction.
+*/
+const double units_per_metre = 1.5;
+
+/*
+    The defaults are those of Newson and Krumm for a consumer receiver, in
+  fixed point units: a GPS error of about 5 m, candidates looked for within
+  50 m, and a route that may differ from the straight line between fixes
+  by a few metres before it becomes unlikely.
+*/
+struct MatchOptions {
+    // standard deviation of the GPS error, in fixed point units
+    double sigma = 5 * units_per_metre;
+    // how far from a fix to look for candidate edges
+    double radius = 50 * units_per_metre;
+    // scale of the difference between route and straight line distance
+    double beta = 5 * units_per_metre;
+    // the nearest candidates kept per point
+    uint32_t max_candidates = 8;
+    // routes longer than this many times the straight line distance, plus
+    // twice the radius, are not searched for
+    double max_detour = 4;
+};
+
+struct GpsPoint {
+    int32_t lat;
+    int32_t lon;
+};
+
+struct MatchResult {
+    // the vertices the matched route passes through, in order
+    std::vector<uint32_t> path;
+    // per point, the edge it was matched to, or RoadMap::no_vertex if it
+    // had no candidates
+    std::vector<uint32_t> edges;
+    // times no route joined the candidates of two consecutive points, so
+    // the match started again from the later one and the path has a gap
+    uint32_t breaks = 0;
+};
+
+/*
+    Matches traces one at a time.  A matcher keeps its search arrays
+  between traces, so a thread should reuse one rather than make one per
+  trace.
+*/
+class MapMatcher {
+public:
+    MapMatcher(const RoadMap &map, const EdgeGrid &grid,
+        const MatchOptions &options = MatchOptions());
+    ~MapMatcher();
+
+    MapMatcher(const MapMatcher &) = delete;
+    MapMatcher &operator=(const MapMatcher &) = delete;
+
+    void match(const std::vector<GpsPoint> &trace, MatchResult &result);
+
+private:
+    struct Search;
+    struct Candidate;
+
+    void candidates(const GpsPoint &point, std::vector<Candidate> &found);
+    void transitions(const GpsPoint &from_point, const GpsPoint &to_point,
+        const std::vector<Candidate> &from, std::vector<Candidate> &to);
+    void append_route(const Candidate &from, const Candidate &to,
+        MatchResult &result);
+
+    const RoadMap &map_;
+    const EdgeGrid &grid_;
+    MatchOptions options_;
+    std::unique_ptr<Search> search_;
+    std::vector<EdgeGrid::Near> near_;
+};
+
+/*
+    Match every trace, on up to num_threads threads (0 picks one per
+  core), leaving the result of traces[i] in results[i].
+*/
+void match_traces(const RoadMap &map, const EdgeGrid &grid,
+    const std::vector<std::vector<GpsPoint>> &traces,
+    std::vector<MatchResult> &results,
+    const MatchOptions &options = MatchOptions(), unsigned num_threads = 0);
+
+#endif
@@ -0,0 +1,262 @@
+/*
+ Match GPS traces onto the road map.
+
+ With a trace file, every trace in it is matched and its vertex path
+ printed as one line of vertex ids.  The file has one fix per line as
+ "<lat>,<lon>" in degrees, and a blank line between traces.
+
+ Without one, traces are made by sampling random shortest paths with
+ added noise, matched with more and more threads, and the matched paths
+ checked against the paths they were sampled from.  The time to snap the
+ fixes one at a time to their nearest vertex by scanning the map is shown
+ for comparison.
+
+ The options set the GPS error sigma, the candidate radius and the route
+ difference scale beta of the match, and the noise added to made up
+ traces, all in metres.  The noise is sigma unless given.  Made up
+ traces have a fix every 40 metres along their path.
+
+ Usage: match_query [-s sigma] [-r radius] [-b beta] [-n noise]
+            <road file> [trace file | -] [max threads] [traces]
+ */
+
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <exception>
+#include <fstream>
+#include <random>
+#include <stdexcept>
+#include <string>
+#include <unordered_set>
+
+#include "dijkstra.h"
+#include "map_match.h"
+#include "parallel.h"
+
+// the distance between the fixes of the made up traces, 40 metres
+static const double sample_step = 40 * units_per_metre;
+
+static std::vector<std::vector<GpsPoint>> read_traces(const char *path) {
+    std::ifstream in(path);
+    if (!in) {
+        throw std::runtime_error(std::string("cannot open ") + path);
+    }
+    std::vector<std::vector<GpsPoint>> traces(1);
+    std::string line;
+    while (std::getline(in, line)) {
+        size_t comma = line.find(',');
+        if (comma == std::string::npos) {
+            if (!traces.back().empty()) {
+                traces.emplace_back();
+            }
+            continue;
+        }
+        const char *p = line.c_str();
+        traces.back().push_back({parse_fixed_coord(p, p + comma),
+            parse_fixed_coord(p + comma + 1, p + line.size())});
+    }
+    if (traces.back().empty()) {
+        traces.pop_back();
+    }
+    return traces;
+}
+
+/*
+    Make num_traces traces by sampling the shortest paths between random
+  vertices every sample_step, with Gaussian noise of sigma, keeping the
+  paths they follow in truth.
+*/
+static void make_traces(const RoadMap &map, size_t num_traces, double sigma,
+        std::vector<std::vector<GpsPoint>> &traces,
+        std::vector<std::vector<uint32_t>> &truth) {
+    std::mt19937 rng(1);
+    std::normal_distribution<double> noise(0, sigma);
+    Dijkstra<RadixHeap<uint32_t>> dijkstra(map);
+    std::vector<uint32_t> path;
+    while (traces.size() < num_traces) {
+        uint32_t s = rng() % map.num_vertices();
+        uint32_t t = rng() % map.num_vertices();
+        if (dijkstra.run(s, t) == dijkstra.unreached) {
+            continue;
+        }
+        dijkstra.path(t, path);
+        if (path.size() < 3) {
+            continue;
+        }
+        std::vector<GpsPoint> trace;
+        double along = 0;
+        for (size_t i = 1; i < path.size(); i++) {
+            double lat1 = map.lat[path[i - 1]], lon1 = map.lon[path[i - 1]];
+            double dlat = map.lat[path[i]] - lat1;
+            double dlon = map.lon[path[i]] - lon1;
+            double length = std::sqrt(dlat * dlat + dlon * dlon);
+            for (; along <= length; along += sample_step) {
+                double f = length > 0 ? along / length : 0;
+                trace.push_back({(int32_t) std::lround(lat1 + f * dlat
+                    + noise(rng)), (int32_t) std::lround(lon1 + f * dlon
+                    + noise(rng))});
+            }
+            along -= length;
+        }
+        traces.push_back(trace);
+        truth.push_back(path);
+    }
+}
+
+// the nearest vertex by looking at all of them, as server.py does
+static uint32_t nearest_by_scan(const RoadMap &map, const GpsPoint &point) {
+    int64_t best = INT64_MAX;
+    uint32_t best_vertex = RoadMap::no_vertex;
+    for (uint32_t v = 0; v < map.num_vertices(); v++) {
+        int64_t dlat = (int64_t) map.lat[v] - point.lat;
+        int64_t dlon = (int64_t) map.lon[v] - point.lon;
+        int64_t d = dlat * dlat + dlon * dlon;
+        if (d < best) {
+            best = d;
+            best_vertex = v;
+        }
+    }
+    return best_vertex;
+}
+
+int main(int argc, char **argv) {
+    MatchOptions options;
+    double noise = -1;
+    std::vector<const char *> args;
+    for (int i = 1; i < argc; i++) {
+        double *option = nullptr;
+        if (std::strcmp(argv[i], "-s") == 0) {
+            option = &options.sigma;
+        } else if (std::strcmp(argv[i], "-r") == 0) {
+            option = &options.radius;
+        } else if (std::strcmp(argv[i], "-b") == 0) {
+            option = &options.beta;
+        } else if (std::strcmp(argv[i], "-n") == 0) {
+            option = &noise;
+        }
+        if (!option) {
+            args.push_back(argv[i]);
+        } else if (++i < argc) {
+            *option = std::atof(argv[i]) * units_per_metre;
+        } else {
+            args.clear();
+            break;
+        }
+    }
+    if (args.empty()) {
+        std::fprintf(stderr, "usage: %s [-s sigma] [-r radius] [-b beta] "
+            "[-n noise] <road file> [trace file | -] [max threads] "
+            "[traces]\n", argv[0]);
+        return 2;
+    }
+    if (noise < 0) {
+        noise = options.sigma;
+    }
+    const char *road_file = args[0];
+    const char *trace_file = args.size() > 1 && std::strcmp(args[1], "-") != 0
+        ? args[1] : nullptr;
+    unsigned max_threads = default_threads(args.size() > 2
+        ? std::atoi(args[2]) : 0);
+    size_t num_traces = args.size() > 3
+        ? std::strtoul(args[3], nullptr, 10) : 500;
+
+    RoadMap map;
+    std::vector<std::vector<GpsPoint>> traces;
+    try {
+        load_road_map(road_file, map);
+        if (trace_file) {
+            traces = read_traces(trace_file);
+        }
+    } catch (const std::exception &e) {
+        std::fprintf(stderr, "%s\n", e.what());
+        return 1;
+    }
+    if (map.num_vertices() == 0) {
+        std::fprintf(stderr, "%s has no vertices\n", road_file);
+        return 1;
+    }
+
+    typedef std::chrono::steady_clock clock;
+    auto start = clock::now();
+    EdgeGrid grid(map, (uint32_t) options.radius);
+    std::fprintf(stderr, "edge grid %.1f ms\n", std::chrono::duration<double,
+        std::milli>(clock::now() - start).count());
+
+    std::vector<MatchResult> results;
+    if (trace_file) {
+        start = clock::now();
+        match_traces(map, grid, traces, results, options, max_threads);
+        std::fprintf(stderr, "matched %zu traces in %.1f ms\n", traces.size(),
+            std::chrono::duration<double, std::milli>(clock::now() - start)
+            .count());
+        for (const MatchResult &result : results) {
+            for (size_t i = 0; i < result.path.size(); i++) {
+                std::printf(i ? " %lld" : "%lld",
+                    (long long) map.vertex_id[result.path[i]]);
+            }
+            std::printf("\n");
+        }
+        return 0;
+    }
+
+    std::vector<std::vector<uint32_t>> truth;
+    make_traces(map, num_traces, noise, traces, truth);
+    size_t num_points = 0;
+    for (auto &trace : traces) {
+        num_points += trace.size();
+    }
+    std::printf("%zu traces, %zu fixes\n", traces.size(), num_points);
+
+    // snapping a sample of fixes one at a time, as the baseline
+    size_t scanned = std::min<size_t>(num_points, 1000);
+    start = clock::now();
+    volatile uint32_t nearest = 0;
+    for (size_t i = 0, k = 0; k < scanned; i++) {
+        for (size_t j = 0; j < traces[i].size() && k < scanned; j++, k++) {
+            nearest = nearest_by_scan(map, traces[i][j]);
+        }
+    }
+    double scan_us = std::chrono::duration<double, std::micro>(
+        clock::now() - start).count() / std::max<size_t>(1, scanned);
+    std::printf("%-22s %10.2f us/fix\n", "nearest vertex scan", scan_us);
+    (void) nearest;
+
+    for (unsigned threads = 1; ; threads = std::min(2 * threads, max_threads)) {
+        start = clock::now();
+        match_traces(map, grid, traces, results, options, threads);
+        double ms = std::chrono::duration<double, std::milli>(
+            clock::now() - start).count();
+        std::printf("threads %-3u %10.2f us/fix %10.0f fixes/s\n", threads,
+            1000 * ms / std::max<size_t>(1, num_points),
+            num_points / (ms / 1000));
+        if (threads == max_threads) {
+            break;
+        }
+    }
+
+    // how much of each true path the match found, and how much of the
+    // match is on the true path
+    size_t true_vertices = 0, found = 0, matched_vertices = 0, correct = 0;
+    uint32_t breaks = 0;
+    for (size_t i = 0; i < traces.size(); i++) {
+        std::unordered_set<uint32_t> on_truth(truth[i].begin(), truth[i].end());
+        std::unordered_set<uint32_t> on_match(results[i].path.begin(),
+            results[i].path.end());
+        for (uint32_t v : truth[i]) {
+            found += on_match.count(v);
+        }
+        for (uint32_t v : results[i].path) {
+            correct += on_truth.count(v);
+        }
+        true_vertices += truth[i].size();
+        matched_vertices += results[i].path.size();
+        breaks += results[i].breaks;
+    }
+    std::printf("recall %.3f precision %.3f breaks %u\n",
+        (double) found / std::max<size_t>(1, true_vertices),
+        (double) correct / std::max<size_t>(1, matched_vertices), breaks);
+    return 0;
+}
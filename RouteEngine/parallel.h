@@ -0,0 +1,122 @@
+/*
+ Small helpers shared by the route engine sources: running a loop on a
+ few threads, holding threads together between the steps of a loop, and
+ mapping a file read only.
+ */
+
+#ifndef PARALLEL_H
+#define PARALLEL_H
+
+#include <algorithm>
+#include <condition_variable>
+#include <cstddef>
+#include <mutex>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+// the number of threads to use when the caller asked for 0
+inline unsigned default_threads(unsigned num_threads) {
+    if (num_threads == 0) {
+        num_threads = std::max(1u, std::thread::hardware_concurrency());
+    }
+    return num_threads;
+}
+
+/*
+    Run body(i) for i in [0, n) on up to num_threads threads, each taking
+  one contiguous block of i.
+*/
+template <typename Body>
+void parallel_for(size_t n, unsigned num_threads, Body body) {
+    std::vector<std::thread> threads;
+    size_t per_thread = (n + num_threads - 1) / num_threads;
+    for (unsigned t = 0; t < num_threads; t++) {
+        size_t begin = t * per_thread;
+        size_t end = std::min(n, begin + per_thread);
+        if (begin >= end) {
+            break;
+        }
+        threads.emplace_back([=] {
+            for (size_t i = begin; i < end; i++) {
+                body(i);
+            }
+        });
+    }
+    for (auto &thread : threads) {
+        thread.join();
+    }
+}
+
+// count threads wait here until all of them have arrived, as often as
+// they like
+class Barrier {
+public:
+    explicit Barrier(unsigned count) : count_(count) {}
+
+    void wait() {
+        std::unique_lock<std::mutex> lock(mutex_);
+        unsigned generation = generation_;
+        if (++waiting_ == count_) {
+            waiting_ = 0;
+            generation_++;
+            released_.notify_all();
+        } else {
+            released_.wait(lock, [&] { return generation_ != generation; });
+        }
+    }
+
+private:
+    std::mutex mutex_;
+    std::condition_variable released_;
+    unsigned count_;
+    unsigned waiting_ = 0;
+    unsigned generation_ = 0;
+};
+
+// a file mapped read only, unmapped when it goes out of scope
+struct MappedFile {
+    const char *data = nullptr;
+    size_t size = 0;
+
+    // Throws std::runtime_error if the file cannot be mapped.
+    explicit MappedFile(const char *path, int advice = MADV_NORMAL) {
+        int fd = open(path, O_RDONLY);
+        if (fd < 0) {
+            throw std::runtime_error(std::string("cannot open ") + path);
+        }
+        struct stat st;
+        if (fstat(fd, &st) < 0) {
+            close(fd);
+            throw std::runtime_error(std::string("cannot stat ") + path);
+        }
+        size = st.st_size;
+        if (size > 0) {
+            void *p = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+            if (p == MAP_FAILED) {
+                close(fd);
+                throw std::runtime_error(std::string("cannot map ") + path);
+            }
+            madvise(p, size, advice);
+            data = (const char *) p;
+        }
+        close(fd);
+    }
+
+    ~MappedFile() {
+        if (data) {
+            munmap((void *) data, size);
+        }
+    }
+
+    MappedFile(const MappedFile &) = delete;
+    MappedFile &operator=(const MappedFile &) = delete;
+};
+
+#endif
@@ -0,0 +1,105 @@
+/*
+ Compare the priority queues of queues.h in Dijkstra on a road network:
+ point to point searches between random vertices, and searches from a
+ random vertex to the whole map.  Every queue must give the same
+ distances.
+
+ Usage: queue_bench <road file> [queries] [full searches]
+ */
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <exception>
+#include <random>
+
+#include "dijkstra.h"
+
+struct Result {
+    double query_us;
+    double full_ms;
+    uint64_t checksum;
+};
+
+template <typename Queue>
+Result bench(const RoadMap &map,
+        const std::vector<std::pair<uint32_t, uint32_t>> &pairs,
+        const std::vector<uint32_t> &sources) {
+    typedef std::chrono::steady_clock clock;
+    Dijkstra<Queue> search(map);
+    Result result = {0, 0, 0};
+
+    auto start = clock::now();
+    for (auto [s, t] : pairs) {
+        auto d = search.run(s, t);
+        result.checksum += d == Dijkstra<Queue>::unreached ? 1 : d;
+    }
+    result.query_us = std::chrono::duration<double, std::micro>(
+        clock::now() - start).count() / std::max<size_t>(1, pairs.size());
+
+    start = clock::now();
+    for (uint32_t s : sources) {
+        search.run(s);
+        result.checksum += search.settled();
+    }
+    result.full_ms = std::chrono::duration<double, std::milli>(
+        clock::now() - start).count() / std::max<size_t>(1, sources.size());
+    return result;
+}
+
+int main(int argc, char **argv) {
+    if (argc < 2) {
+        std::fprintf(stderr, "usage: %s <road file> [queries] [full searches]\n",
+            argv[0]);
+        return 2;
+    }
+    unsigned queries = argc > 2 ? std::atoi(argv[2]) : 200;
+    unsigned full = argc > 3 ? std::atoi(argv[3]) : 20;
+
+    RoadMap map;
+    try {
+        load_road_map(argv[1], map);
+    } catch (const std::exception &e) {
+        std::fprintf(stderr, "%s\n", e.what());
+        return 1;
+    }
+    uint32_t n = map.num_vertices();
+    if (n == 0) {
+        std::fprintf(stderr, "%s has no vertices\n", argv[1]);
+        return 1;
+    }
+
+    std::mt19937 rng(1);
+    std::vector<std::pair<uint32_t, uint32_t>> pairs(queries);
+    for (auto &pair : pairs) {
+        pair = {rng() % n, rng() % n};
+    }
+    std::vector<uint32_t> sources(full);
+    for (uint32_t &s : sources) {
+        s = rng() % n;
+    }
+
+    struct Row {
+        const char *name;
+        Result result;
+    } rows[] = {
+        {"binary heap", bench<BinaryHeap<uint32_t>>(map, pairs, sources)},
+        {"4-ary heap", bench<DaryHeap<uint32_t, 4>>(map, pairs, sources)},
+        {"4-ary heap, 64 bit", bench<DaryHeap<uint64_t, 4>>(map, pairs, sources)},
+        {"radix heap", bench<RadixHeap<uint32_t>>(map, pairs, sources)},
+        {"dial buckets", bench<DialQueue<uint32_t>>(map, pairs, sources)},
+    };
+
+    std::printf("%-20s %12s %12s\n", "queue", "us/query", "ms/full");
+    bool same = true;
+    for (const Row &row : rows) {
+        std::printf("%-20s %12.1f %12.2f\n", row.name, row.result.query_us,
+            row.result.full_ms);
+        same = same && row.result.checksum == rows[0].result.checksum;
+    }
+    if (!same) {
+        std::printf("queues disagree on distances\n");
+        return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,266 @@
+/*
+ Priority queues of vertices keyed by integer distance, for the searches
+ in dijkstra.h.
+
+ They share one interface so a search can be instantiated on any of them:
+     Queue(uint32_t num_vertices, key_type max_edge)
+     void push(uint32_t v, key_type key)
+     bool empty() const
+     std::pair<key_type, uint32_t> pop()     the smallest key
+     void clear()
+ and declare
+     key_type                the integer key
+     decrease_key            true if push lowers the key of a vertex
+                             already queued, false if it queues v again
+                             and the search must skip stale entries
+ The radix heap and the Dial queue are monotone: a key pushed must not be
+ less than the last key popped, which Dijkstra with non-negative edge
+ costs guarantees.
+ */
+
+#ifndef QUEUES_H
+#define QUEUES_H
+
+#include <cstdint>
+#include <functional>
+#include <queue>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+// std::priority_queue, a lazy binary heap, as the baseline
+template <typename Key>
+class BinaryHeap {
+public:
+    typedef Key key_type;
+    static constexpr bool decrease_key = false;
+
+    BinaryHeap(uint32_t, Key) {}
+
+    void push(uint32_t v, Key key) { heap_.push({key, v}); }
+    bool empty() const { return heap_.empty(); }
+
+    std::pair<Key, uint32_t> pop() {
+        std::pair<Key, uint32_t> top = heap_.top();
+        heap_.pop();
+        return top;
+    }
+
+    void clear() { heap_ = decltype(heap_)(); }
+
+private:
+    std::priority_queue<std::pair<Key, uint32_t>,
+        std::vector<std::pair<Key, uint32_t>>,
+        std::greater<std::pair<Key, uint32_t>>> heap_;
+};
+
+/*
+    An indexed D-ary heap with decrease key.  With D = 4 a node's children
+  share a cache line and the tree is half as deep as a binary heap.
+*/
+template <typename Key, unsigned D = 4>
+class DaryHeap {
+public:
+    typedef Key key_type;
+    static constexpr bool decrease_key = true;
+
+    DaryHeap(uint32_t num_vertices, Key) : pos_(num_vertices, absent) {}
+
+    void push(uint32_t v, Key key) {
+        uint32_t i = pos_[v];
+        if (i == absent) {
+            i = heap_.size();
+            heap_.push_back({key, v});
+        } else if (key < heap_[i].first) {
+            heap_[i].first = key;
+        } else {
+            return;
+        }
+        sift_up(i);
+    }
+
+    bool empty() const { return heap_.empty(); }
+
+    std::pair<Key, uint32_t> pop() {
+        std::pair<Key, uint32_t> top = heap_[0];
+        pos_[top.second] = absent;
+        std::pair<Key, uint32_t> last = heap_.back();
+        heap_.pop_back();
+        if (!heap_.empty()) {
+            heap_[0] = last;
+            sift_down(0);
+        }
+        return top;
+    }
+
+    void clear() {
+        for (auto &item : heap_) {
+            pos_[item.second] = absent;
+        }
+        heap_.clear();
+    }
+
+private:
+    static const uint32_t absent = UINT32_MAX;
+
+    void sift_up(uint32_t i) {
+        std::pair<Key, uint32_t> item = heap_[i];
+        while (i > 0) {
+            uint32_t parent = (i - 1) / D;
+            if (heap_[parent].first <= item.first) {
+                break;
+            }
+            heap_[i] = heap_[parent];
+            pos_[heap_[i].second] = i;
+            i = parent;
+        }
+        heap_[i] = item;
+        pos_[item.second] = i;
+    }
+
+    void sift_down(uint32_t i) {
+        std::pair<Key, uint32_t> item = heap_[i];
+        uint32_t size = heap_.size();
+        while (true) {
+            uint32_t first = i * D + 1;
+            if (first >= size) {
+                break;
+            }
+            uint32_t last = first + D < size ? first + D : size;
+            uint32_t best = first;
+            for (uint32_t c = first + 1; c < last; c++) {
+                if (heap_[c].first < heap_[best].first) {
+                    best = c;
+                }
+            }
+            if (item.first <= heap_[best].first) {
+                break;
+            }
+            heap_[i] = heap_[best];
+            pos_[heap_[i].second] = i;
+            i = best;
+        }
+        heap_[i] = item;
+        pos_[item.second] = i;
+    }
+
+    std::vector<std::pair<Key, uint32_t>> heap_;
+    std::vector<uint32_t> pos_;
+};
+
+/*
+    A radix heap: bucket b holds keys that first differ from the last key
+  popped in bit b-1, so a key moves down at most once per bit and a pop
+  costs amortized O(bits of Key).
+*/
+template <typename Key>
+class RadixHeap {
+    static_assert(std::is_unsigned<Key>::value, "radix heap keys are unsigned");
+
+public:
+    typedef Key key_type;
+    static constexpr bool decrease_key = false;
+
+    RadixHeap(uint32_t, Key) {}
+
+    void push(uint32_t v, Key key) {
+        buckets_[bucket_of(key)].push_back({key, v});
+        size_++;
+    }
+
+    bool empty() const { return size_ == 0; }
+
+    std::pair<Key, uint32_t> pop() {
+        if (buckets_[0].empty()) {
+            unsigned b = 1;
+            while (buckets_[b].empty()) {
+                b++;
+            }
+            // the smallest key in the first non-empty bucket becomes the
+            // last key, and the rest of the bucket spreads below it
+            Key smallest = buckets_[b][0].first;
+            for (auto &item : buckets_[b]) {
+                if (item.first < smallest) {
+                    smallest = item.first;
+                }
+            }
+            last_ = smallest;
+            for (auto &item : buckets_[b]) {
+                buckets_[bucket_of(item.first)].push_back(item);
+            }
+            buckets_[b].clear();
+        }
+        std::pair<Key, uint32_t> top = buckets_[0].back();
+        buckets_[0].pop_back();
+        size_--;
+        return top;
+    }
+
+    void clear() {
+        for (auto &bucket : buckets_) {
+            bucket.clear();
+        }
+        last_ = 0;
+        size_ = 0;
+    }
+
+private:
+    static constexpr unsigned bits = sizeof(Key) * 8;
+
+    unsigned bucket_of(Key key) const {
+        uint64_t diff = (uint64_t) (key ^ last_);
+        return diff == 0 ? 0 : 64 - __builtin_clzll(diff);
+    }
+
+    std::vector<std::pair<Key, uint32_t>> buckets_[bits + 1];
+    Key last_ = 0;
+    size_t size_ = 0;
+};
+
+/*
+    Dial's bucket queue: one bucket per key, in a ring of max_edge + 1
+  buckets, since every queued key is within max_edge of the last key
+  popped.  Pushes are O(1) and a pop scans forward over empty buckets,
+  which pays off when edge costs are small integers.
+*/
+template <typename Key>
+class DialQueue {
+public:
+    typedef Key key_type;
+    static constexpr bool decrease_key = false;
+
+    DialQueue(uint32_t, Key max_edge) : buckets_((size_t) max_edge + 1) {}
+
+    void push(uint32_t v, Key key) {
+        buckets_[key % buckets_.size()].push_back(v);
+        size_++;
+    }
+
+    bool empty() const { return size_ == 0; }
+
+    std::pair<Key, uint32_t> pop() {
+        while (buckets_[current_ % buckets_.size()].empty()) {
+            current_++;
+        }
+        std::vector<uint32_t> &bucket = buckets_[current_ % buckets_.size()];
+        uint32_t v = bucket.back();
+        bucket.pop_back();
+        size_--;
+        return {current_, v};
+    }
+
+    void clear() {
+        for (auto &bucket : buckets_) {
+            bucket.clear();
+        }
+        current_ = 0;
+        size_ = 0;
+    }
+
+private:
+    std::vector<std::vector<uint32_t>> buckets_;
+    Key current_ = 0;
+    size_t size_ = 0;
+};
+
+#endif
@@ -0,0 +1,99 @@
+/*
+ Time bounded radius searches by delta-stepping with more and more
+ threads, check them against Dijkstra with the same budget, and print
+ the hull of the last.
+
+ Usage: reach_query <road file> [budget] [max threads] [sources] [delta]
+ */
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <exception>
+#include <random>
+
+#include "delta_stepping.h"
+#include "dijkstra.h"
+#include "parallel.h"
+
+int main(int argc, char **argv) {
+    if (argc < 2) {
+        std::fprintf(stderr, "usage: %s <road file> [budget] [max threads] "
+            "[sources] [delta]\n", argv[0]);
+        return 2;
+    }
+    uint32_t budget = argc > 2 ? std::strtoul(argv[2], nullptr, 10) : no_distance;
+    unsigned max_threads = default_threads(argc > 3 ? std::atoi(argv[3]) : 0);
+    unsigned sources = argc > 4 ? std::atoi(argv[4]) : 5;
+    uint32_t delta = argc > 5 ? std::strtoul(argv[5], nullptr, 10) : 0;
+    if (budget == 0) {
+        budget = no_distance;
+    }
+
+    RoadMap map;
+    try {
+        load_road_map(argv[1], map);
+    } catch (const std::exception &e) {
+        std::fprintf(stderr, "%s\n", e.what());
+        return 1;
+    }
+    if (map.num_vertices() == 0) {
+        std::fprintf(stderr, "%s has no vertices\n", argv[1]);
+        return 1;
+    }
+
+    typedef std::chrono::steady_clock clock;
+    std::mt19937 rng(1);
+    std::vector<uint32_t> from(sources);
+    for (uint32_t &s : from) {
+        s = rng() % map.num_vertices();
+    }
+
+    // Dijkstra within the same budget, as the reference
+    Dijkstra<RadixHeap<uint32_t>> dijkstra(map);
+    auto start = clock::now();
+    for (uint32_t s : from) {
+        dijkstra.run_within(s, budget);
+    }
+    std::printf("%-22s %10.2f ms\n", "dijkstra, radix heap",
+        std::chrono::duration<double, std::milli>(clock::now() - start).count()
+        / std::max(1u, sources));
+
+    unsigned bad = 0;
+    std::vector<uint32_t> reached;
+    for (unsigned threads = 1; ; threads = std::min(2 * threads, max_threads)) {
+        DeltaStepping search(map, threads, delta);
+        double ms = 0;
+        for (uint32_t s : from) {
+            start = clock::now();
+            search.run(s, budget);
+            ms += std::chrono::duration<double, std::milli>(
+                clock::now() - start).count();
+
+            dijkstra.run_within(s, budget);
+            for (uint32_t v = 0; v < map.num_vertices(); v++) {
+                if (search.distance(v) != dijkstra.distance(v)) {
+                    bad++;
+                }
+            }
+        }
+        std::printf("delta %-6u threads %-3u %10.2f ms\n", search.delta(),
+            threads, ms / std::max(1u, sources));
+        if (threads == max_threads) {
+            search.reached(reached);
+            break;
+        }
+    }
+
+    auto hull = convex_hull(map, reached);
+    std::printf("reached %zu vertices, hull of %zu corners (lat lon):\n",
+        reached.size(), hull.size());
+    for (auto &corner : hull) {
+        std::printf("  %d %d\n", corner.first, corner.second);
+    }
+    if (bad) {
+        std::printf("%u distances differ from dijkstra\n", bad);
+        return 1;
+    }
+    return 0;
+}
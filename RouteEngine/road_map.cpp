@@ -0,0 +1,308 @@
+#include "road_map.h"
+
+#include <algorithm>
+#include <cmath>
+#include <numeric>
+
+#include "parallel.h"
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+/*
+    Loader for the road network text file.
+
+    The file is memory mapped and cut into one chunk per thread, each
+    boundary moved forward to just past a newline so no line is split.
+    Every thread scans its chunk for newlines and commas sixteen bytes at a
+    time with SSE2 compares, parses the fields in place, and collects its
+    vertices and edges in file order.  The chunks are then concatenated,
+    vertex ids are sorted for lookup, the edge end points are resolved to
+    dense indices in parallel, and the CSR arrays are built by a counting
+    sort that keeps the edges of each vertex in file order.
+*/
+
+namespace {
+
+// first c in [p, end), or end if there is none
+const char *find_byte(const char *p, const char *end, char c) {
+#ifdef __SSE2__
+    const __m128i needle = _mm_set1_epi8(c);
+    while (end - p >= 16) {
+        __m128i block = _mm_loadu_si128((const __m128i *) p);
+        int mask = _mm_movemask_epi8(_mm_cmpeq_epi8(block, needle));
+        if (mask) {
+            return p + __builtin_ctz(mask);
+        }
+        p += 16;
+    }
+#endif
+    while (p < end && *p != c) {
+        p++;
+    }
+    return p;
+}
+
+int64_t parse_int(const char *p, const char *end) {
+    bool negative = p < end && *p == '-';
+    if (negative) {
+        p++;
+    }
+    int64_t value = 0;
+    for (; p < end && *p >= '0' && *p <= '9'; p++) {
+        value = value * 10 + (*p - '0');
+    }
+    return negative ? -value : value;
+}
+
+// the records of one chunk of the file, in file order
+struct Chunk {
+    std::vector<int64_t> vertex_id;
+    std::vector<int32_t> lat;
+    std::vector<int32_t> lon;
+    std::vector<int64_t> edge_from;
+    std::vector<int64_t> edge_to;
+    // per edge, how many vertex records came before it in the chunk
+    std::vector<uint32_t> edge_after;
+    std::string names;
+    std::vector<uint32_t> name_end;
+};
+
+void parse_chunk(const char *p, const char *end, Chunk &chunk) {
+    // the fields of the current line, at most four are used
+    const char *field[4];
+    const char *field_end[4];
+
+    while (p < end) {
+        const char *line_end = find_byte(p, end, '\n');
+        const char *next = line_end + 1;
+        if (line_end > p && line_end[-1] == '\r') {
+            line_end--;
+        }
+
+        int n = 0;
+        const char *q = p;
+        while (n < 4) {
+            // the street name is the rest of the line, commas and all
+            const char *comma = n < 3 ? find_byte(q, line_end, ',') : line_end;
+            field[n] = q;
+            field_end[n] = comma;
+            n++;
+            if (comma == line_end) {
+                break;
+            }
+            q = comma + 1;
+        }
+
+        if (n == 4 && field_end[0] - field[0] == 1) {
+            if (*field[0] == 'V') {
+                chunk.vertex_id.push_back(parse_int(field[1], field_end[1]));
+                chunk.lat.push_back(parse_fixed_coord(field[2], field_end[2]));
+                chunk.lon.push_back(parse_fixed_coord(field[3], field_end[3]));
+            } else if (*field[0] == 'E') {
+                chunk.edge_from.push_back(parse_int(field[1], field_end[1]));
+                chunk.edge_to.push_back(parse_int(field[2], field_end[2]));
+                chunk.edge_after.push_back((uint32_t) chunk.vertex_id.size());
+                chunk.names.append(field[3], field_end[3]);
+                chunk.name_end.push_back((uint32_t) chunk.names.size());
+            }
+        }
+
+        p = next;
+    }
+}
+
+} // namespace
+
+int32_t parse_fixed_coord(const char *p, const char *end) {
+    bool negative = p < end && *p == '-';
+    if (negative || (p < end && *p == '+')) {
+        p++;
+    }
+
+    int32_t value = 0;
+    for (; p < end && *p >= '0' && *p <= '9'; p++) {
+        value = value * 10 + (*p - '0');
+    }
+
+    // exactly five decimal places, padding with zeros and dropping the rest
+    int digits = 0;
+    if (p < end && *p == '.') {
+        for (p++; p < end && digits < 5 && *p >= '0' && *p <= '9'; p++) {
+            value = value * 10 + (*p - '0');
+            digits++;
+        }
+    }
+    for (; digits < 5; digits++) {
+        value *= 10;
+    }
+
+    return negative ? -value : value;
+}
+
+uint32_t RoadMap::index_of(int64_t id) const {
+    auto it = std::lower_bound(sorted_id.begin(), sorted_id.end(), id);
+    if (it == sorted_id.end() || *it != id) {
+        return no_vertex;
+    }
+    return sorted_index[it - sorted_id.begin()];
+}
+
+uint32_t edge_cost(const RoadMap &map, uint32_t u, uint32_t v) {
+    double dlat = (double) map.lat[v] - map.lat[u];
+    double dlon = (double) map.lon[v] - map.lon[u];
+    return (uint32_t) std::lround(std::sqrt(dlat * dlat + dlon * dlon));
+}
+
+void load_road_map(const char *path, RoadMap &map, unsigned num_threads) {
+    num_threads = default_threads(num_threads);
+
+    MappedFile file(path, MADV_SEQUENTIAL);
+    const char *data = file.data;
+    const char *data_end = data + file.size;
+
+    // chunk boundaries, each just past a newline
+    std::vector<const char *> bound(num_threads + 1, data_end);
+    bound[0] = data;
+    for (unsigned t = 1; t < num_threads; t++) {
+        const char *p = data + file.size / num_threads * t;
+        p = std::max(p, bound[t - 1]);
+        p = find_byte(p, data_end, '\n');
+        bound[t] = p < data_end ? p + 1 : data_end;
+    }
+
+    std::vector<Chunk> chunks(num_threads);
+    parallel_for(num_threads, num_threads, [&](size_t t) {
+        parse_chunk(bound[t], bound[t + 1], chunks[t]);
+    });
+
+    // concatenate the chunks
+    map = RoadMap();
+    std::vector<int64_t> edge_from_id;
+    std::vector<int64_t> edge_to_id;
+    std::vector<uint32_t> edge_after;
+    map.name_offset.push_back(0);
+    for (Chunk &chunk : chunks) {
+        uint32_t vertex_base = (uint32_t) map.vertex_id.size();
+        map.vertex_id.insert(map.vertex_id.end(),
+            chunk.vertex_id.begin(), chunk.vertex_id.end());
+        map.lat.insert(map.lat.end(), chunk.lat.begin(), chunk.lat.end());
+        map.lon.insert(map.lon.end(), chunk.lon.begin(), chunk.lon.end());
+        edge_from_id.insert(edge_from_id.end(),
+            chunk.edge_from.begin(), chunk.edge_from.end());
+        edge_to_id.insert(edge_to_id.end(),
+            chunk.edge_to.begin(), chunk.edge_to.end());
+        for (uint32_t after : chunk.edge_after) {
+            edge_after.push_back(vertex_base + after);
+        }
+
+        uint32_t base = (uint32_t) map.names.size();
+        map.names += chunk.names;
+        for (uint32_t end : chunk.name_end) {
+            map.name_offset.push_back(base + end);
+        }
+        chunk = Chunk();
+    }
+
+    // Sort the ids for lookup.  A repeated id is one vertex, in the place
+    // it first appeared but at the last location given for it, as the
+    // dictionaries of server.py have it.
+    uint32_t records = map.num_vertices();
+    std::vector<uint32_t> order(records);
+    std::iota(order.begin(), order.end(), 0);
+    std::stable_sort(order.begin(), order.end(), [&](uint32_t a, uint32_t b) {
+        return map.vertex_id[a] < map.vertex_id[b];
+    });
+    // per sorted id, the record it first appeared in
+    std::vector<uint32_t> first_record;
+    std::vector<uint32_t> index(records, RoadMap::no_vertex);
+    for (uint32_t k = 0; k < records; ) {
+        uint32_t first = order[k];
+        uint32_t last = first;
+        for (k++; k < records && map.vertex_id[order[k]] == map.vertex_id[first];
+                k++) {
+            last = order[k];
+        }
+        map.lat[first] = map.lat[last];
+        map.lon[first] = map.lon[last];
+        map.sorted_id.push_back(map.vertex_id[first]);
+        first_record.push_back(first);
+        index[first] = 0;
+    }
+
+    // drop the repeats, numbering the vertices that are left in file order
+    uint32_t n = 0;
+    for (uint32_t r = 0; r < records; r++) {
+        if (index[r] != RoadMap::no_vertex) {
+            index[r] = n;
+            map.vertex_id[n] = map.vertex_id[r];
+            map.lat[n] = map.lat[r];
+            map.lon[n] = map.lon[r];
+            n++;
+        }
+    }
+    map.vertex_id.resize(n);
+    map.lat.resize(n);
+    map.lon.resize(n);
+    for (uint32_t r : first_record) {
+        map.sorted_index.push_back(index[r]);
+    }
+
+    // Resolve the edge end points.  As with Graph.add_edge, an end point
+    // only counts if its vertex came before the edge in the file.
+    auto resolve = [&](int64_t id, uint32_t after) {
+        auto it = std::lower_bound(map.sorted_id.begin(), map.sorted_id.end(),
+            id);
+        size_t k = it - map.sorted_id.begin();
+        if (it == map.sorted_id.end() || *it != id || first_record[k] >= after) {
+            return RoadMap::no_vertex;
+        }
+        return map.sorted_index[k];
+    };
+    size_t m = edge_from_id.size();
+    std::vector<uint32_t> from(m);
+    std::vector<uint32_t> to(m);
+    parallel_for(m, num_threads, [&](size_t i) {
+        from[i] = resolve(edge_from_id[i], edge_after[i]);
+        to[i] = resolve(edge_to_id[i], edge_after[i]);
+    });
+
+    // drop edges to unknown or later vertices, with their names
+    std::string names;
+    std::vector<uint32_t> name_offset(1, 0);
+    for (size_t i = 0; i < m; i++) {
+        if (from[i] == RoadMap::no_vertex || to[i] == RoadMap::no_vertex) {
+            continue;
+        }
+        map.edge_from.push_back(from[i]);
+        map.edge_to.push_back(to[i]);
+        names.append(map.names, map.name_offset[i],
+            map.name_offset[i + 1] - map.name_offset[i]);
+        name_offset.push_back((uint32_t) names.size());
+    }
+    map.names.swap(names);
+    map.name_offset.swap(name_offset);
+
+    // counting sort into CSR, keeping file order within each vertex
+    m = map.edge_from.size();
+    map.first_out.assign(n + 1, 0);
+    for (uint32_t u : map.edge_from) {
+        map.first_out[u + 1]++;
+    }
+    for (uint32_t v = 0; v < n; v++) {
+        map.first_out[v + 1] += map.first_out[v];
+    }
+    map.head.resize(m);
+    std::vector<uint32_t> fill(map.first_out.begin(), map.first_out.end() - 1);
+    for (size_t i = 0; i < m; i++) {
+        map.head[fill[map.edge_from[i]]++] = map.edge_to[i];
+    }
+
+    map.weight.resize(m);
+    parallel_for(n, num_threads, [&](size_t u) {
+        for (uint32_t e = map.first_out[u]; e < map.first_out[u + 1]; e++) {
+            map.weight[e] = edge_cost(map, (uint32_t) u, map.head[e]);
+        }
+    });
+}
@@ -0,0 +1,83 @@
+/*
+ The road network read from the V/E text file, held as a compressed
+ sparse row (CSR) graph over dense vertex indices.
+
+ The text file has one record per line:
+     V,<vertex id>,<lat>,<lon>
+     E,<from id>,<to id>,<street name>
+ Coordinates are kept in the same fixed point as server.py, 100000ths of
+ a degree truncated towards zero, so results can be passed straight back
+ to the Arduino client.
+ */
+
+#ifndef ROAD_MAP_H
+#define ROAD_MAP_H
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+struct RoadMap {
+    // per vertex, indexed 0 .. num_vertices()-1 in file order
+    std::vector<int64_t> vertex_id;
+    std::vector<int32_t> lat;
+    std::vector<int32_t> lon;
+
+    // out edges of vertex v are first_out[v] .. first_out[v+1]-1, with
+    // their end vertex in head and their cost in weight
+    std::vector<uint32_t> first_out;
+    std::vector<uint32_t> head;
+    std::vector<uint32_t> weight;
+
+    // per edge, in file order, for callers that want the edge list back
+    std::vector<uint32_t> edge_from;
+    std::vector<uint32_t> edge_to;
+
+    // street name of edge i is names[name_offset[i] .. name_offset[i+1])
+    std::string names;
+    std::vector<uint32_t> name_offset;
+
+    // vertex_id sorted, with the index of each, for index_of
+    std::vector<int64_t> sorted_id;
+    std::vector<uint32_t> sorted_index;
+
+    uint32_t num_vertices() const { return (uint32_t) vertex_id.size(); }
+    uint32_t num_edges() const { return (uint32_t) head.size(); }
+
+    // dense index of a vertex id, or no_vertex if it is not in the map
+    static const uint32_t no_vertex = UINT32_MAX;
+    uint32_t index_of(int64_t id) const;
+};
+
+/*
+    The cost of the edge from u to v: the straight line distance between
+  them in fixed point units, rounded to the nearest integer.  This is the
+  cost_distance of server.py made integral so that searches can use
+  integer priority queues.
+*/
+uint32_t edge_cost(const RoadMap &map, uint32_t u, uint32_t v);
+
+// the distance between vertices that cannot reach each other
+const uint32_t no_distance = UINT32_MAX;
+
+/*
+    Parse the road network text file at path into map, using up to
+  num_threads threads (0 picks one per core).  The file is memory mapped
+  and split into chunks on line boundaries that are parsed in parallel.
+  The map is the one load_edmonton_road_map in server.py reads in Python:
+  an edge is dropped unless both its end points are vertices given on
+  earlier lines, as Graph.add_edge does, and a vertex given more than once
+  keeps its first place in vertex order but takes its last location.
+
+  Throws std::runtime_error if the file cannot be read.
+*/
+void load_road_map(const char *path, RoadMap &map, unsigned num_threads = 0);
+
+/*
+    Parse one fixed point coordinate such as "-113.491331" starting at p
+  and ending before end, truncated to five decimal places digit by digit
+  as process_coord does in server.py, so no float rounding comes in.
+*/
+int32_t parse_fixed_coord(const char *p, const char *end);
+
+#endif
@@ -0,0 +1,126 @@
+#include "cell_graph.h"
+#include "road_map.h"
+
+#include <algorithm>
+#include <cstring>
+#include <exception>
+
+/*
+    C interface to the loader for use from Python through ctypes, see
+    ServerAndClientImplentation/road_map_native.py.  A map handle is a
+    RoadMap allocated by road_map_load and released by road_map_free.
+    The array arguments must have room for the number of vertices, the
+    number of edges, or one more than that for the offset arrays.
+
+    A cell graph handle is a CellGraph opened by cell_graph_open and
+    released by cell_graph_close; its vertices are the cell graph's own
+    numbers, not indices of a RoadMap.
+*/
+
+static std::string last_error;
+
+extern "C" {
+
+void *road_map_load(const char *path, unsigned num_threads) {
+    RoadMap *map = new RoadMap();
+    try {
+        load_road_map(path, *map, num_threads);
+    } catch (const std::exception &e) {
+        last_error = e.what();
+        delete map;
+        return nullptr;
+    }
+    return map;
+}
+
+const char *road_map_last_error() {
+    return last_error.c_str();
+}
+
+void road_map_free(void *handle) {
+    delete (RoadMap *) handle;
+}
+
+uint32_t road_map_num_vertices(const void *handle) {
+    return ((const RoadMap *) handle)->num_vertices();
+}
+
+uint32_t road_map_num_edges(const void *handle) {
+    return ((const RoadMap *) handle)->num_edges();
+}
+
+void road_map_vertices(const void *handle,
+    int64_t *id, int32_t *lat, int32_t *lon) {
+    const RoadMap &map = *(const RoadMap *) handle;
+    uint32_t n = map.num_vertices();
+    std::memcpy(id, map.vertex_id.data(), n * sizeof(int64_t));
+    std::memcpy(lat, map.lat.data(), n * sizeof(int32_t));
+    std::memcpy(lon, map.lon.data(), n * sizeof(int32_t));
+}
+
+void road_map_csr(const void *handle, uint32_t *first_out, uint32_t *head) {
+    const RoadMap &map = *(const RoadMap *) handle;
+    std::memcpy(first_out, map.first_out.data(),
+        map.first_out.size() * sizeof(uint32_t));
+    std::memcpy(head, map.head.data(), map.head.size() * sizeof(uint32_t));
+}
+
+void road_map_edges(const void *handle, uint32_t *from, uint32_t *to) {
+    const RoadMap &map = *(const RoadMap *) handle;
+    uint32_t m = map.num_edges();
+    std::memcpy(from, map.edge_from.data(), m * sizeof(uint32_t));
+    std::memcpy(to, map.edge_to.data(), m * sizeof(uint32_t));
+}
+
+uint32_t road_map_names_size(const void *handle) {
+    return (uint32_t) ((const RoadMap *) handle)->names.size();
+}
+
+void road_map_names(const void *handle, char *names, uint32_t *offset) {
+    const RoadMap &map = *(const RoadMap *) handle;
+    std::memcpy(names, map.names.data(), map.names.size());
+    std::memcpy(offset, map.name_offset.data(),
+        map.name_offset.size() * sizeof(uint32_t));
+}
+
+void *cell_graph_open(const char *path) {
+    try {
+        return new CellGraph(path);
+    } catch (const std::exception &e) {
+        last_error = e.what();
+        return nullptr;
+    }
+}
+
+void cell_graph_close(void *handle) {
+    delete (CellGraph *) handle;
+}
+
+uint32_t cell_graph_nearest(const void *handle, int32_t lat, int32_t lon) {
+    return ((const CellGraph *) handle)->nearest(lat, lon);
+}
+
+void cell_graph_location(const void *handle, uint32_t v,
+    int32_t *lat, int32_t *lon) {
+    const CellGraph &cells = *(const CellGraph *) handle;
+    *lat = cells.lat(v);
+    *lon = cells.lon(v);
+}
+
+/*
+    Route from s to t, storing up to max_path vertices of it in path.
+  Returns the number of vertices in the route, which is more than max_path
+  if it did not fit, or 0 if t cannot be reached.
+*/
+uint32_t cell_graph_route(const void *handle, uint32_t s, uint32_t t,
+    uint32_t *path, uint32_t max_path) {
+    std::vector<uint32_t> route;
+    if (!((const CellGraph *) handle)->route(s, t, route)) {
+        return 0;
+    }
+    std::memcpy(path, route.data(),
+        std::min<size_t>(route.size(), max_path) * sizeof(uint32_t));
+    return (uint32_t) route.size();
+}
+
+}
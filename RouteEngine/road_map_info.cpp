@@ -0,0 +1,35 @@
+/*
+ Load a road network text file and report its size and the load time.
+
+ Usage: road_map_info <road file> [threads]
+ */
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <exception>
+
+#include "road_map.h"
+
+int main(int argc, char **argv) {
+    if (argc < 2) {
+        std::fprintf(stderr, "usage: %s <road file> [threads]\n", argv[0]);
+        return 2;
+    }
+    unsigned threads = argc > 2 ? std::atoi(argv[2]) : 0;
+
+    RoadMap map;
+    auto start = std::chrono::steady_clock::now();
+    try {
+        load_road_map(argv[1], map, threads);
+    } catch (const std::exception &e) {
+        std::fprintf(stderr, "%s\n", e.what());
+        return 1;
+    }
+    double ms = std::chrono::duration<double, std::milli>(
+        std::chrono::steady_clock::now() - start).count();
+
+    std::printf("vertices %u\nedges %u\nload ms %.1f\n",
+        map.num_vertices(), map.num_edges(), ms);
+    return 0;
+}
@@ -0,0 +1,675 @@
+/*
+ Load generator for the route server.
+
+ Emulates N Arduino clients, each on its own pseudo-terminal, speaking the
+ protocol of client.cpp: a request is one line "R <id> <lat1> <lon1> <lat2>
+ <lon2>", each route comes back as "N <id> <count>" and the lat and lon of
+ each vertex on lines of their own, and "X <id>" cancels a request.  Each
+ client keeps several requests outstanding and, like a user who picks new
+ points before the route arrives, cancels the latest of them when it sends
+ the next.  Every answer is checked: routes must come in the order they
+ were asked for, a request may be passed over only if it was cancelled,
+ and a path may end early with "!" only if it was.  A cancel can cross the
+ start of its route on the link, so a cancelled request may still be
+ answered; those answers are counted apart.
+
+ With -L the clients speak the older protocol instead: the start and then
+ the stop point as "lon, lat" lines, answered by the bare count and the
+ vertices (or "!" if the path is cut short), one request at a time.
+
+ The points are replayed from a file or picked at random on the map,
+ writes are paced to the 9600 baud of the real link, and the throughput
+ and latency percentiles are reported at the end.  The latency of a
+ request runs from sending it to the last line of its route, so it
+ includes the wait behind routes asked for earlier.
+
+ Usage: route_loadgen [options]
+     -n clients       number of emulated clients (1)
+     -r requests      requests per client (10)
+     -t seconds       think time between requests of a client (1)
+     -k requests      requests a client keeps outstanding (3)
+     -c fraction      fraction of requests that replace the latest one
+                      still outstanding, cancelling it; these are sent
+                      even with -k requests outstanding (0.2)
+     -L               speak the older two line protocol, one request at
+                      a time, without ids or cancelling
+     -p file          replay start/stop points, one request per line as
+                      "lon1 lat1 lon2 lat2"; random points otherwise
+     -b baud          pacing of the writes, 0 to write at full speed (9600)
+     -m vertices      cancel a route after this many vertices, like a
+                      full path arena on the client: "X <id>", or "!"
+                      with -L (0, never)
+     -s command       start "command <pty>" for each client, such as
+                      "python3 server.py"; otherwise the pty paths are
+                      printed and the run starts after -w seconds
+     -1               start one "command <pty> <pty> ..." for all the
+                      clients instead, for a server that multiplexes
+     -w seconds       time to wait for the servers to open the ptys (5)
+     -T seconds       give up on a response after this long (120)
+     -S seed          random seed (1)
+
+ Each client owns its pty for the whole run, so a server that opens the
+ pty sees an ordinary serial port.
+ */
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <deque>
+#include <mutex>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <fcntl.h>
+#include <poll.h>
+#include <signal.h>
+#include <sys/wait.h>
+#include <termios.h>
+#include <unistd.h>
+
+namespace {
+
+typedef std::chrono::steady_clock Clock;
+
+struct Options {
+    int clients = 1;
+    int requests = 10;
+    double think_seconds = 1;
+    int outstanding = 3;
+    double cancel_rate = 0.2;
+    bool legacy = false;
+    const char *points_file = nullptr;
+    int baud = 9600;
+    int max_vertices = 0;
+    const char *server_command = nullptr;
+    bool one_server = false;
+    double wait_seconds = 5;
+    double timeout_seconds = 120;
+    unsigned seed = 1;
+};
+
+// a start and stop point, in the fixed point of the client
+struct Request {
+    int32_t lon1, lat1, lon2, lat2;
+};
+
+// the bounding box of map 0 in map.cpp
+const int32_t map_north = 5364463;
+const int32_t map_west = -11373047;
+const int32_t map_south = 5343572;
+const int32_t map_east = -11337891;
+
+// the outcome of one request
+struct Sample {
+    double latency_ms;         // stop point sent to last line received
+    double first_vertex_ms;    // stop point sent to first vertex received
+    int vertices;
+};
+
+struct Results {
+    std::mutex lock;
+    std::vector<Sample> samples;
+    int failures = 0;
+    int cancelled = 0;
+    int cut_short = 0;          // routes ended by "!"
+    int crossed = 0;            // routes started after their cancel was sent
+};
+
+struct Client {
+    int master = -1;
+    int slave = -1;
+    std::string pty;
+    pid_t server = -1;
+};
+
+bool open_pty(Client &client) {
+    client.master = posix_openpt(O_RDWR | O_NOCTTY);
+    if (client.master < 0 || grantpt(client.master) < 0 ||
+        unlockpt(client.master) < 0) {
+        return false;
+    }
+    client.pty = ptsname(client.master);
+
+    // Hold the slave open so the pty is not hung up when a server closes
+    // it, and make it raw so line endings pass through untouched.
+    client.slave = open(client.pty.c_str(), O_RDWR | O_NOCTTY);
+    if (client.slave < 0) {
+        return false;
+    }
+    struct termios tio;
+    tcgetattr(client.slave, &tio);
+    cfmakeraw(&tio);
+    tcsetattr(client.slave, TCSANOW, &tio);
+    return true;
+}
+
+/*
+    Write s to fd no faster than baud allows, 10 bits to a byte as on the
+  serial line.  Returns false if the write fails.
+*/
+bool paced_write(int fd, const std::string &s, int baud) {
+    auto start = Clock::now();
+    for (size_t i = 0; i < s.size(); i++) {
+        if (write(fd, &s[i], 1) != 1) {
+            return false;
+        }
+        if (baud > 0) {
+            std::this_thread::sleep_until(start +
+                std::chrono::microseconds((i + 1) * 10000000LL / baud));
+        }
+    }
+    return true;
+}
+
+// reads lines from the master side of a pty
+struct LineReader {
+    int fd;
+    std::string buffer;
+    bool failed = false;    // the last next() failed on an error
+
+    /*
+        Read the next non-empty line into line, waiting until deadline.
+      Returns false on timeout or error, and sets failed on error.
+    */
+    bool next(std::string &line, Clock::time_point deadline) {
+        failed = false;
+        while (true) {
+            size_t end = buffer.find_first_of("\r\n");
+            while (end == 0) {
+                buffer.erase(0, 1);
+                end = buffer.find_first_of("\r\n");
+            }
+            if (end != std::string::npos) {
+                line = buffer.substr(0, end);
+                buffer.erase(0, end + 1);
+                return true;
+            }
+
+            auto left = std::chrono::duration_cast<std::chrono::milliseconds>(
+                deadline - Clock::now()).count();
+            if (left <= 0) {
+                return false;
+            }
+            struct pollfd pfd = { fd, POLLIN, 0 };
+            if (poll(&pfd, 1, (int) std::min<long long>(left, 1000)) < 0) {
+                failed = true;
+                return false;
+            }
+            if (pfd.revents & POLLIN) {
+                char chunk[256];
+                ssize_t n = read(fd, chunk, sizeof(chunk));
+                if (n <= 0) {
+                    failed = true;
+                    return false;
+                }
+                buffer.append(chunk, n);
+            }
+        }
+    }
+};
+
+std::string point_line(int32_t lon, int32_t lat) {
+    // as Serial.print(cursor_lon); Serial.print(", "); Serial.println(lat)
+    return std::to_string(lon) + ", " + std::to_string(lat) + "\r\n";
+}
+
+/*
+    Send one request in the older protocol and read the whole answer.
+  Returns false if the answer did not arrive in time or did not make
+  sense.
+*/
+bool run_legacy_request(const Options &options, Client &client,
+    LineReader &reader, const Request &request, Sample &sample) {
+    if (!paced_write(client.master, point_line(request.lon1, request.lat1),
+            options.baud) ||
+        !paced_write(client.master, point_line(request.lon2, request.lat2),
+            options.baud)) {
+        return false;
+    }
+    auto sent = Clock::now();
+    auto deadline = sent + std::chrono::duration_cast<Clock::duration>(
+        std::chrono::duration<double>(options.timeout_seconds));
+
+    std::string line;
+    if (!reader.next(line, deadline)) {
+        return false;
+    }
+    int count = std::atoi(line.c_str());
+
+    sample.first_vertex_ms = 0;
+    sample.vertices = 0;
+    bool asked_to_stop = false;
+    for (int values = 0; values < 2 * count; values++) {
+        if (!reader.next(line, deadline)) {
+            return false;
+        }
+        if (line == "!") {
+            break;
+        }
+        if (values == 1) {
+            sample.first_vertex_ms = std::chrono::duration<double,
+                std::milli>(Clock::now() - sent).count();
+        }
+        if (values % 2 == 1) {
+            sample.vertices++;
+            if (options.max_vertices > 0 && !asked_to_stop &&
+                sample.vertices >= options.max_vertices) {
+                paced_write(client.master, "!\r\n", options.baud);
+                asked_to_stop = true;
+            }
+        }
+    }
+
+    sample.latency_ms = std::chrono::duration<double, std::milli>(
+        Clock::now() - sent).count();
+    return true;
+}
+
+void run_legacy_client(const Options &options, Client &client,
+    const std::vector<Request> &replay, unsigned seed, Results &results) {
+    std::mt19937 random(seed);
+    std::uniform_int_distribution<int32_t> lon(map_west, map_east);
+    std::uniform_int_distribution<int32_t> lat(map_south, map_north);
+    LineReader reader = { client.master, std::string(), false };
+
+    for (int i = 0; i < options.requests; i++) {
+        Request request;
+        if (!replay.empty()) {
+            request = replay[random() % replay.size()];
+        } else {
+            request = { lon(random), lat(random), lon(random), lat(random) };
+        }
+
+        Sample sample;
+        bool ok = run_legacy_request(options, client, reader, request,
+            sample);
+        {
+            std::lock_guard<std::mutex> guard(results.lock);
+            if (ok) {
+                results.samples.push_back(sample);
+            } else {
+                results.failures++;
+            }
+        }
+        if (!ok) {
+            // the link is out of step, drop whatever is left of the answer
+            reader.buffer.clear();
+            tcflush(client.master, TCIFLUSH);
+        }
+
+        std::this_thread::sleep_for(
+            std::chrono::duration<double>(options.think_seconds));
+    }
+}
+
+// a request of the newer protocol, sent and not yet answered or passed over
+struct Pending {
+    int id;
+    Clock::time_point sent;
+    bool cancelled;
+};
+
+/*
+    Run the requests of one client in the newer protocol, keeping up to
+  options.outstanding of them in flight and checking every answer.  A
+  request counts as failed if its answer is late or breaks the protocol,
+  and the client then drops what is left of the answers and goes on.
+*/
+void run_client(const Options &options, Client &client,
+    const std::vector<Request> &replay, unsigned seed, Results &results) {
+    std::mt19937 random(seed);
+    std::uniform_int_distribution<int32_t> lon(map_west, map_east);
+    std::uniform_int_distribution<int32_t> lat(map_south, map_north);
+    std::uniform_real_distribution<double> chance(0, 1);
+    LineReader reader = { client.master, std::string(), false };
+    auto timeout = std::chrono::duration_cast<Clock::duration>(
+        std::chrono::duration<double>(options.timeout_seconds));
+    auto think = std::chrono::duration_cast<Clock::duration>(
+        std::chrono::duration<double>(options.think_seconds));
+
+    // oldest first; while a route is being read it is the front one
+    std::deque<Pending> pending;
+    int next_id = 1;
+    // after a failure, lines are skipped up to the next route, and the
+    // routes of requests below resync_id are dropped
+    bool resyncing = false;
+    int resync_id = 1;
+    bool in_route = false, dropping = false, asked_to_stop = false;
+    int count = 0, values = 0;
+    Sample sample;
+    auto next_request = Clock::now();
+    bool replace_next = chance(random) < options.cancel_rate;
+
+    auto fail = [&](const std::string &why) {
+        std::fprintf(stderr, "%s: %s\n", client.pty.c_str(), why.c_str());
+        int failed = 0;
+        for (const Pending &p : pending) {
+            failed += !p.cancelled;
+        }
+        {
+            std::lock_guard<std::mutex> guard(results.lock);
+            results.failures += failed;
+        }
+        pending.clear();
+        in_route = false;
+        resyncing = true;
+        resync_id = next_id;
+        reader.buffer.clear();
+        tcflush(client.master, TCIFLUSH);
+    };
+    auto finish = [&]() {
+        const Pending &p = pending.front();
+        if (!dropping && !p.cancelled) {
+            sample.latency_ms = std::chrono::duration<double, std::milli>(
+                Clock::now() - p.sent).count();
+            std::lock_guard<std::mutex> guard(results.lock);
+            results.samples.push_back(sample);
+        }
+        if (!dropping) {
+            pending.pop_front();
+        }
+        in_route = false;
+    };
+
+    while (next_id <= options.requests || !pending.empty()) {
+        auto now = Clock::now();
+        int live = 0;
+        for (const Pending &p : pending) {
+            live += !p.cancelled;
+        }
+        // new points picked while routes are on the way replace the
+        // latest of them
+        bool replace = replace_next && !pending.empty()
+            && !pending.back().cancelled;
+        bool can_send = next_id <= options.requests
+            && (live < options.outstanding || replace);
+        if (can_send && now >= next_request) {
+            Request r;
+            if (!replay.empty()) {
+                r = replay[random() % replay.size()];
+            } else {
+                r = { lon(random), lat(random), lon(random), lat(random) };
+            }
+            if (replace) {
+                if (!paced_write(client.master, "X "
+                        + std::to_string(pending.back().id) + "\r\n",
+                        options.baud)) {
+                    fail("write failed");
+                    return;
+                }
+                pending.back().cancelled = true;
+                std::lock_guard<std::mutex> guard(results.lock);
+                results.cancelled++;
+            }
+            std::string line = "R " + std::to_string(next_id) + " "
+                + std::to_string(r.lat1) + " " + std::to_string(r.lon1) + " "
+                + std::to_string(r.lat2) + " " + std::to_string(r.lon2)
+                + "\r\n";
+            if (!paced_write(client.master, line, options.baud)) {
+                fail("write failed");
+                return;
+            }
+            pending.push_back({next_id++, Clock::now(), false});
+            next_request = Clock::now() + think;
+            replace_next = chance(random) < options.cancel_rate;
+            continue;
+        }
+
+        // wait for a line until the next request is due, or the oldest
+        // request still wanted is out of time
+        Clock::time_point send_due = can_send ? next_request
+            : Clock::time_point::max();
+        Clock::time_point answer_due = Clock::time_point::max();
+        for (const Pending &p : pending) {
+            if (!p.cancelled || (in_route && &p == &pending.front())) {
+                answer_due = p.sent + timeout;
+                break;
+            }
+        }
+        std::string line;
+        if (!reader.next(line, std::min(send_due, answer_due))) {
+            if (reader.failed) {
+                fail("read failed");
+                return;
+            }
+            if (answer_due <= send_due) {
+                fail("no answer in time");
+            }
+            continue;
+        }
+
+        if (!in_route) {
+            int id;
+            char tail;
+            if (std::sscanf(line.c_str(), "N %d %d %c", &id, &count, &tail)
+                    != 2 || count < 0) {
+                if (!resyncing) {
+                    fail("expected a route, got \"" + line + "\"");
+                }
+                continue;
+            }
+            resyncing = false;
+            in_route = true;
+            dropping = id < resync_id;
+            asked_to_stop = false;
+            values = 0;
+            sample = Sample();
+            if (dropping) {
+                if (count == 0) {
+                    finish();
+                }
+                continue;
+            }
+            // routes come in request order, and only a cancelled
+            // request is passed over
+            while (!pending.empty() && pending.front().id < id
+                    && pending.front().cancelled) {
+                pending.pop_front();
+            }
+            if (pending.empty() || pending.front().id != id) {
+                fail("route " + std::to_string(id) + " out of order");
+                continue;
+            }
+            if (pending.front().cancelled) {
+                std::lock_guard<std::mutex> guard(results.lock);
+                results.crossed++;
+            }
+            if (count == 0) {
+                finish();
+            }
+            continue;
+        }
+
+        if (line == "!") {
+            if (!dropping && !pending.front().cancelled && !asked_to_stop) {
+                fail("route " + std::to_string(pending.front().id)
+                    + " ended early");
+                continue;
+            }
+            if (!dropping) {
+                std::lock_guard<std::mutex> guard(results.lock);
+                results.cut_short++;
+            }
+            finish();
+            continue;
+        }
+        values++;
+        if (values % 2 == 0) {
+            sample.vertices++;
+            if (!dropping && sample.vertices == 1) {
+                sample.first_vertex_ms = std::chrono::duration<double,
+                    std::milli>(Clock::now() - pending.front().sent).count();
+            }
+            if (!dropping && options.max_vertices > 0 && !asked_to_stop
+                    && sample.vertices >= options.max_vertices) {
+                paced_write(client.master, "X "
+                    + std::to_string(pending.front().id) + "\r\n",
+                    options.baud);
+                asked_to_stop = true;
+            }
+        }
+        if (values == 2 * count) {
+            finish();
+        }
+    }
+}
+
+std::vector<Request> read_points(const char *path) {
+    std::vector<Request> requests;
+    FILE *f = std::fopen(path, "r");
+    if (!f) {
+        std::perror(path);
+        std::exit(1);
+    }
+    Request r;
+    while (std::fscanf(f, "%d %d %d %d", &r.lon1, &r.lat1, &r.lon2, &r.lat2)
+           == 4) {
+        requests.push_back(r);
+    }
+    std::fclose(f);
+    return requests;
+}
+
+double percentile(std::vector<double> values, double q) {
+    if (values.empty()) {
+        return 0;
+    }
+    std::sort(values.begin(), values.end());
+    size_t i = (size_t) (q * (values.size() - 1) + 0.5);
+    return values[std::min(i, values.size() - 1)];
+}
+
+void usage(const char *name) {
+    std::fprintf(stderr, "usage: %s [-n clients] [-r requests] "
+        "[-t think secs] [-k outstanding] [-c cancel fraction] [-L] "
+        "[-p points file] [-b baud] [-m max vertices] "
+        "[-s server command] [-1] [-w wait secs] [-T timeout secs] [-S seed]\n",
+        name);
+    std::exit(2);
+}
+
+// run command in a process group of its own, so it can be stopped with
+// everything it starts
+pid_t start_server(const std::string &command) {
+    pid_t pid = fork();
+    if (pid == 0) {
+        setpgid(0, 0);
+        execl("/bin/sh", "sh", "-c", command.c_str(), (char *) nullptr);
+        _exit(127);
+    }
+    return pid;
+}
+
+} // namespace
+
+int main(int argc, char **argv) {
+    Options options;
+    int opt;
+    while ((opt = getopt(argc, argv, "n:r:t:k:c:Lp:b:m:s:1w:T:S:")) != -1) {
+        switch (opt) {
+        case 'n': options.clients = std::atoi(optarg); break;
+        case 'r': options.requests = std::atoi(optarg); break;
+        case 't': options.think_seconds = std::atof(optarg); break;
+        case 'k': options.outstanding = std::atoi(optarg); break;
+        case 'c': options.cancel_rate = std::atof(optarg); break;
+        case 'L': options.legacy = true; break;
+        case 'p': options.points_file = optarg; break;
+        case 'b': options.baud = std::atoi(optarg); break;
+        case 'm': options.max_vertices = std::atoi(optarg); break;
+        case 's': options.server_command = optarg; break;
+        case '1': options.one_server = true; break;
+        case 'w': options.wait_seconds = std::atof(optarg); break;
+        case 'T': options.timeout_seconds = std::atof(optarg); break;
+        case 'S': options.seed = std::atoi(optarg); break;
+        default: usage(argv[0]);
+        }
+    }
+    if (options.clients < 1 || options.outstanding < 1) {
+        usage(argv[0]);
+    }
+
+    std::vector<Request> replay;
+    if (options.points_file) {
+        replay = read_points(options.points_file);
+    }
+
+    std::vector<Client> clients(options.clients);
+    std::string all_ptys;
+    for (Client &client : clients) {
+        if (!open_pty(client)) {
+            std::perror("pty");
+            return 1;
+        }
+        all_ptys += " " + client.pty;
+        if (options.server_command && !options.one_server) {
+            client.server = start_server(
+                std::string(options.server_command) + " " + client.pty);
+        } else if (!options.server_command) {
+            std::printf("%s\n", client.pty.c_str());
+        }
+    }
+    if (options.server_command && options.one_server) {
+        clients[0].server =
+            start_server(std::string(options.server_command) + all_ptys);
+    }
+    std::fflush(stdout);
+    std::this_thread::sleep_for(
+        std::chrono::duration<double>(options.wait_seconds));
+
+    Results results;
+    auto start = Clock::now();
+    std::vector<std::thread> threads;
+    for (int i = 0; i < options.clients; i++) {
+        threads.emplace_back(
+            options.legacy ? run_legacy_client : run_client, std::cref(options),
+            std::ref(clients[i]), std::cref(replay), options.seed + i,
+            std::ref(results));
+    }
+    for (auto &thread : threads) {
+        thread.join();
+    }
+    double seconds =
+        std::chrono::duration<double>(Clock::now() - start).count();
+
+    for (Client &client : clients) {
+        if (client.server > 0) {
+            kill(-client.server, SIGTERM);
+            waitpid(client.server, nullptr, 0);
+        }
+        close(client.slave);
+        close(client.master);
+    }
+
+    std::vector<double> latency;
+    std::vector<double> first_vertex;
+    long vertices = 0;
+    for (const Sample &s : results.samples) {
+        latency.push_back(s.latency_ms);
+        if (s.vertices > 0) {
+            first_vertex.push_back(s.first_vertex_ms);
+        }
+        vertices += s.vertices;
+    }
+
+    std::printf("clients %d\nrequests %zu\nfailures %d\nseconds %.1f\n",
+        options.clients, results.samples.size(), results.failures, seconds);
+    if (!options.legacy) {
+        std::printf("cancelled %d, routes started after the cancel %d, "
+            "routes cut short %d\n", results.cancelled, results.crossed,
+            results.cut_short);
+    }
+    std::printf("throughput %.2f requests/s, %.1f vertices/s\n",
+        results.samples.size() / seconds, vertices / seconds);
+    std::printf("latency ms p50 %.1f p90 %.1f p99 %.1f p99.9 %.1f max %.1f\n",
+        percentile(latency, 0.5), percentile(latency, 0.9),
+        percentile(latency, 0.99), percentile(latency, 0.999),
+        percentile(latency, 1));
+    std::printf("first vertex ms p50 %.1f p99 %.1f\n",
+        percentile(first_vertex, 0.5), percentile(first_vertex, 0.99));
+    return results.failures > 0;
+}
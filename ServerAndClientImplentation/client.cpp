@@ -4,11 +4,16 @@
   to another based on joystick clicks
  */
 #include <Arduino.h>
+#include <stdio.h>
 #include <Adafruit_ST7735.h> 
 #include <SD.h>
 #include <mem_syms.h>
 
 #include "map.h"
+#include "overlay.h"
+#include "path.h"
+#include "profile.h"
+#include "route_cache.h"
 #include "serial_handling.h"
 
 // #define DEBUG_SCROLLING
@@ -42,7 +47,8 @@ void initialize_joystick();
 uint8_t process_joystick(int16_t *dx, int16_t *dy);
 void status_msg(char *msg);
 void clear_status_msg();
-void draw_path();
+void redraw_status_msg();
+void status_progress(uint16_t done, uint16_t total);
 
 // Interrupt routines for zooming in and out.
 void handle_zoom_in();
@@ -68,6 +74,8 @@ void setup() {
 
     initialize_sd_card();
 
+    route_cache_init();
+
     initialize_joystick();
 
     initialize_map();
@@ -109,15 +117,34 @@ const uint16_t screen_top_margin = 10;
 const uint16_t screen_bottom_margin = 117;
 
 // the path request, start and stop lat and lon
-uint8_t request_state = 0;  // 0 - wait for start, 1 - wait for stop point
+// 0 - wait for start, 1 - wait for stop point
+uint8_t request_state = 0;
 int32_t start_lat;
 int32_t start_lon;
-int32_t stop_lat;
-int32_t stop_lon;
-int32_t* points; 
-int edges;
+
+// Requests are numbered so their routes can be told apart.  Only the
+// route of the latest request is drawn; when new points are picked
+// before it has all arrived the old request is cancelled, and any of its
+// route that is already on the way is read and dropped.
+uint16_t next_request_id = 1;
+uint16_t wanted_id = 0;     // latest request, 0 before the first
+uint8_t route_waiting;      // the latest route has not all arrived
+uint8_t route_showing;      // the route being received is the latest
+route_key_t wanted_key;     // start and stop of the latest request
+
+// the routes being received from the server
+route_rx_t route;
+
+// set once the path being received no longer fits and has been cut short
+uint8_t path_truncated;
+
+// time the path was requested, and how long after that the first segment
+// of it appeared on screen (0 if none has yet)
+uint32_t path_request_time;
+uint32_t path_first_pixel_time;
 
 void loop() {
+    uint32_t loop_start = micros();
 
     // Make sure we don't update the map tile on screen when we don't need to!
     uint8_t update_display_window = 0;
@@ -125,6 +152,7 @@ void loop() {
     if ( first_time ) {
         first_time = 0;
         update_display_window = 1;
+        route_rx_init(&route);
         }
 
     // Joystick displacement.
@@ -219,7 +247,9 @@ void loop() {
             else {
                 // erase old cursor, move, and draw new one, no need to 
                 // redraw the underlying map tile
+                uint32_t erase_start = micros();
                 erase_cursor();
+                prof_record(prof_erase_cursor, erase_start);
                 move_cursor_by(dx, dy);
                 draw_cursor();
                 }
@@ -235,67 +265,134 @@ void loop() {
     if (select_button_event) {
         // Button was pressed, we are selecting a point!
         // which press is this, the start or the stop selection?
+        if (request_state == 0) {
+            start_lat = cursor_lat;
+            start_lon = cursor_lon;
+            request_state = 1;
+            }
+        else {
+            // Points can be picked while a route is still arriving, in
+            // which case that route is stale: cancel it, so the server
+            // stops sending it and gets on with the new one.
+            if (route_waiting) {
+                Serial.print("X ");
+                Serial.println(wanted_id);
+                }
 
-        // If we are making a request to find a shortest path, we will send out
-        // the request on the serial port and then wait for a response from the
-        // server.  While this is happening, the client user interface is
-        // suspended.
+            // a route picked before is drawn from the SD card, and only
+            // the others are asked of the server
+            route_cache_key(&wanted_key, start_lat, start_lon,
+                cursor_lat, cursor_lon);
+            uint32_t cache_start = micros();
+            uint8_t cached = route_cache_load(&wanted_key);
+            prof_record(prof_route_cache, cache_start);
+
+            if (cached) {
+                wanted_id = 0;
+                route_waiting = 0;
+                route_showing = 0;
+                path_truncated = 0;
+                update_display_window = 1;
+                }
+            else {
+                wanted_id = next_request_id;
+                next_request_id++;
+                if (next_request_id == 0) {
+                    next_request_id = 1;
+                    }
+
+                // The server answers with the path, which is picked up below a
+                // little at a time on every pass of the loop, so the joystick
+                // and zoom buttons keep working while it arrives.
+                Serial.print("R ");
+                Serial.print(wanted_id);
+                Serial.print(" ");
+                Serial.print(start_lat);
+                Serial.print(" ");
+                Serial.print(start_lon);
+                Serial.print(" ");
+                Serial.print(cursor_lat);
+                Serial.print(" ");
+                Serial.println(cursor_lon);
+
+                route_waiting = 1;
+                route_showing = 0;
+                path_request_time = micros();
+                path_first_pixel_time = 0;
+                }
+            request_state = 0;
+            }
+        }
+    // end of select_button_event processing
+
+    // pick up whatever part of the path has arrived
+    uint32_t route_rx_start_time = micros();
+    uint8_t route_rx_active = route_waiting
+        || route.state != route_rx_header;
+    uint8_t route_event;
+    while ( (route_event = route_rx_poll(&route)) != route_rx_none ) {
+        if ( route_event == route_rx_got_count ) {
+            // a route for a request that has since been replaced is
+            // read to its end without drawing anything
+            route_showing = route.id == wanted_id;
+            if ( route_showing ) {
+                path_clear();
+                path_truncated = 0;
+
+                // Gets rid of old lines before the new ones start appearing
+                update_display_window = 1;
+                }
+            }
+        else if ( route_event == route_rx_got_vertex ) {
+            if ( !route_showing ) {
+                continue;
+                }
+            uint8_t stored = path_add_vertex(route.lat, route.lon);
+            if ( !stored && !path_truncated ) {
+                // Out of room for the path.  Tell the server to stop, and
+                // keep receiving, dropping the vertices, until it does so
+                // the link stays in step.
+                Serial.print("X ");
+                Serial.println(route.id);
+                path_truncated = 1;
+                }
 
-        // if the stop point, then we send out the server request and wait.
+            // the old path is still on screen until the redraw below, so
+            // only draw the new segments once it has been erased
+            if ( stored && !update_display_window && draw_path_last_segment()
+                 && path_first_pixel_time == 0 ) {
+                path_first_pixel_time = micros() - path_request_time;
+                #ifdef DEBUG_PATH
+                    Serial.print("First path pixel us: ");
+                    Serial.println(path_first_pixel_time);
+                #endif
+                }
+            if ( request_state == 0 ) {
+                status_progress(route.num_received, route.num_vertices);
+                }
+            }
+        else if ( route_event == route_rx_done ) {
+            if ( route_showing && !path_truncated
+                 && route.num_received == route.num_vertices ) {
+                // only whole routes are kept for next time
+                uint32_t cache_start = micros();
+                route_cache_store(&wanted_key);
+                prof_record(prof_route_cache, cache_start);
+                }
+            if ( route_showing ) {
+                route_waiting = 0;
+                route_showing = 0;
+                }
+            }
+        else if ( route.rx.line[0] == 'P' ) {
+            // the host wants the profiling counters
+            prof_dump();
+            }
+        }
 
-		// This is a place holder for the code you need to write. This simply
-		//prints the position of the cursor to the Serial port. 
-      
-     //Remove these two lines and fill in your own code here.
-    
-      
-              Serial.print(cursor_lon);
-              Serial.print(", ");
-              Serial.println(cursor_lat);
-	      request_state += 1;
-	      
-	      //Variable to see if two points were selected
-	      static int x = 0;
-	      if (x > 0) {
-		free(points);
-		//Waiting for signal
-	      	while(!Serial.available()){};
-	       
-		//Area to store data
-		char s[128];
-		serial_readline(s,128);
-
-		//converting string to number of edges
-	        edges = string_get_int(s);
-
-	
-		
-		//Variables for loops
-		int count = 0;
-		int32_t lat_lon;
-		points = (int32_t*) malloc(sizeof(int32_t) * 2 * edges);
-		  
-		while (count < (edges * 2)){
-		  // Read the point
-		  serial_readline(s,128);
-		  // converting to an int
-		  lat_lon = string_get_int(s);
-		  // putting data into a array
-		  points[count] = lat_lon;		  
-		  // increment 
-		  count++;
-		} 
-		//Gets rid of old lines
-	        update_display_window = 1;
-		x = 0;
-		request_state = 0;
-	      }
-	      else {
-		x ++;
-	      }
-    }
- 
- // end of select_button_event processing
+    if ( route_rx_active ) {
+        prof_record(prof_route_rx, route_rx_start_time);
+        }
 
     // do we have to redraw the map tile?  
     if (update_display_window) {
@@ -309,9 +406,13 @@ void loop() {
             Serial.println();
         #endif
 
+        uint32_t draw_start = micros();
         draw_map_screen();
+        prof_record(prof_draw_map, draw_start);
         draw_cursor();
-	draw_path();
+        draw_start = micros();
+        draw_path();
+        prof_record(prof_draw_path, draw_start);
 
         // Need to redraw any other things that are on the screen. Hint: Path
 
@@ -320,14 +421,20 @@ void loop() {
         }
 
     // always update the status message area if message changes
-    // Indicate which point we are waiting for
-    if ( request_state == 0 ) {
+    // Indicate which point we are waiting for, unless the progress of a
+    // route is showing there
+    if ( request_state == 1 ) {
+        status_msg("TO?");
+        }
+    else if ( !route_waiting ) {
         status_msg("FROM?");
         }
-    else {
-        status_msg("TO?");
-	
-    }
+    else if ( !route_showing ) {
+        status_msg("ROUTING");
+        }
+
+    prof_sample_memory();
+    prof_record(prof_loop, loop_start);
    
 }
 char* prev_status_msg = 0;
@@ -336,6 +443,22 @@ void clear_status_msg() {
     status_msg("");
     }
 
+void redraw_status_msg() {
+    char *msg = prev_status_msg;
+    prev_status_msg = 0;
+    status_msg(msg ? msg : (char *) "");
+    }
+
+char progress_msg[20];
+
+void status_progress(uint16_t done, uint16_t total) {
+    // the message text changes but the buffer does not, so force the
+    // redraw by clearing the previous message
+    snprintf(progress_msg, sizeof(progress_msg), "PATH %u/%u", done, total);
+    prev_status_msg = 0;
+    status_msg(progress_msg);
+    }
+
 void status_msg(char *msg) {
     // messages are strings, so we assume constant, and if they are the
     // same pointer then the contents are the same.  You can force by
@@ -343,11 +466,11 @@ void status_msg(char *msg) {
 
     if ( prev_status_msg != msg ) {
         prev_status_msg = msg;
-        tft.fillRect(0, 148, 128, 12, GREEN);
+        tft.fillRect(0, status_bar_top, 128, status_bar_height, GREEN);
 
         tft.setTextSize(1);
         tft.setTextColor(MAGENTA);
-        tft.setCursor(0, 150);
+        tft.setCursor(0, status_bar_top + 2);
         tft.setTextSize(1);
 
         tft.println(msg);
@@ -521,27 +644,3 @@ void handle_zoom_out() {
         out_prev_intr_time = cur_intr_time;
     }
 }
-
-/*
-This function will take the shortest path and draw it the map
-*/
-void draw_path(){
-  //This will run through all the elements in the point list
-  for(int i = 0; i < ((edges*2) - 2); i+=2){
-
-    //This will get all the direct lines lat/lon to be drawn
-    int32_t lat_prev = points[i];
-    int32_t lon_prev = points[i+1];
-    int32_t lat = points[i+2];
-    int32_t lon = points[i+3];
-    
-    //This will convert lat/lon to printable x and y locations 
-    int32_t y_prev = latitude_to_y(current_map_num, lat_prev) - screen_map_y;
-    int32_t x_prev = longitude_to_x(current_map_num, lon_prev)- screen_map_x;
-    int32_t y = latitude_to_y(current_map_num, lat)- screen_map_y;
-    int32_t x = longitude_to_x(current_map_num, lon) - screen_map_x;
-
-    tft.drawLine(x_prev,y_prev,x,y,RED);
-    
-  }
-}
@@ -0,0 +1,477 @@
+"""
+Event loop for the route server.
+
+One thread waits in a selector (epoll on Linux) on every link to a
+client, serial ports and TCP connections alike, and on a pipe that
+the search threads use to hand back finished routes. Nothing in the
+loop blocks: the point lines of a request are gathered as they come
+in, the search runs on a thread pool, and the path is streamed out
+while other links are read, searched for and written to.
+
+Writes go through a per-link output buffer that is flushed when the
+link is writable. The vertices of a path are released into it one
+at a time, no faster than pace seconds apart so the Arduino has time
+to draw each segment, and not at all while the buffer is above
+HIGH_WATER bytes, so a slow link only holds up its own path.
+
+The protocol on each link is the one of client.cpp. A request is
+one line, "R <id> <lat1> <lon1> <lat2> <lon2>", and is answered by
+"N <id> <count>" and then a lat and a lon line for each vertex. A
+client may send more requests before the answers come; their
+searches run at once and the paths are sent one after another in
+the order they were asked for. "X <id>" cancels a request: one not
+yet answered is dropped without an answer, and one whose path is
+being sent is ended early with "!".
+
+The older protocol, two "lon, lat" point lines answered by the
+bare count and the vertices, and "!" from the client to end the
+path, is still served, for older clients and route_loadgen -L.
+
+Usage:
+    server = EventServer(search, parse_request)
+    server.add_serial("/dev/ttyACM0")
+    server.listen(9200)
+    server.run()
+"""
+import collections
+import os
+import selectors
+import socket
+import sys
+import time
+from concurrent.futures import ThreadPoolExecutor
+
+import metrics
+
+# The seconds between the vertices of a path, which the Arduino needs
+# to draw each segment before the next arrives
+PACE_SECONDS = 0.1
+
+# Bytes queued for a link above which no more vertices are released
+HIGH_WATER = 256
+
+# Lines a client may send to end its session
+QUIT_LINES = {"q", "Q", "quit", "exit", "Quit", "Exit"}
+
+def parse_tagged_request(line):
+    """
+    The id and the (lat1, lon1, lat2, lon2) of a request line, or
+    None if it is not one.
+
+    >>> parse_tagged_request("R 7 5350000 -11350000 5351000 -11340000")
+    (7, (5350000, -11350000, 5351000, -11340000))
+    >>> parse_tagged_request("R 7 5350000 -11350000") is None
+    True
+    """
+    fields = line.split()
+    if len(fields) != 6 or fields[0] != "R":
+        return None
+    try:
+        values = [int(f) for f in fields[1:]]
+    except ValueError:
+        return None
+    return values[0], tuple(values[1:])
+
+class Request:
+    """
+    A request of a link, from when it is read until its path has
+    been sent. id is None for a request in the older protocol.
+    """
+    def __init__(self, id):
+        self.id = id
+        self.future = None
+        self.path = None
+
+class Link:
+    """
+    One client connection with its buffers and its requests.
+    """
+    def __init__(self, name, fd, read, write, close):
+        self.name = name
+        self.fd = fd
+        self.read = read
+        self.write = write
+        self.close = close
+        self.inbuf = b""
+        self.outbuf = bytearray()
+        # point lines of the older protocol not yet made into a request
+        self.lines = collections.deque()
+        self.first_line_time = None
+        # requests in the order they were made, the first of them the
+        # one being answered or next to be
+        self.requests = collections.deque()
+        # the vertex lines still to send, and when the next may go
+        self.sending = None
+        self.send_start = 0
+        self.next_send = 0
+        self.events = selectors.EVENT_READ
+        self.closed = False
+
+class EventServer:
+    """
+    The links, the selector that watches them and the thread pool
+    that runs their searches.
+
+    search(request) runs on a pool thread and returns the path as
+    a list of (lat, lon). parse_request(line1, line2) turns two
+    point lines into a request, or returns None if they are not
+    valid.
+    """
+    def __init__(self, search, parse_request, threads=4, pace=PACE_SECONDS):
+        self.search = search
+        self.parse_request = parse_request
+        self.pace = pace
+        self.selector = selectors.DefaultSelector()
+        self.pool = ThreadPoolExecutor(max_workers=threads)
+        self.links = {}
+        self.listeners = {}
+
+        # finished searches, and the pipe that wakes the loop for them
+        self.done = collections.deque()
+        self.wake_read, self.wake_write = os.pipe()
+        os.set_blocking(self.wake_read, False)
+        os.set_blocking(self.wake_write, False)
+        self.selector.register(self.wake_read, selectors.EVENT_READ, None)
+
+    def add_serial(self, port, baud=9600):
+        """
+        Serve the Arduino on the serial port. The port is opened
+        with pyserial for its line settings, then used directly
+        through its file descriptor without blocking.
+        """
+        import serial
+        ser = serial.Serial(port, baud)
+        fd = ser.fileno()
+        os.set_blocking(fd, False)
+        self._add(Link(port, fd, lambda: os.read(fd, 4096),
+                       lambda data: os.write(fd, data), ser.close))
+
+    def listen(self, port, host="127.0.0.1"):
+        """
+        Accept clients speaking the same protocol over TCP on port.
+        """
+        sock = socket.socket(socket.AF_INET, socket.SOCK_STREAM)
+        sock.setsockopt(socket.SOL_SOCKET, socket.SO_REUSEADDR, 1)
+        sock.bind((host, port))
+        sock.listen()
+        sock.setblocking(False)
+        self.listeners[sock.fileno()] = sock
+        self.selector.register(sock, selectors.EVENT_READ, None)
+
+    def _accept(self, listener):
+        try:
+            sock, address = listener.accept()
+        except BlockingIOError:
+            return
+        sock.setblocking(False)
+        sock.setsockopt(socket.IPPROTO_TCP, socket.TCP_NODELAY, 1)
+        self._add(Link("%s:%d" % address, sock.fileno(),
+                       lambda: sock.recv(4096), sock.send, sock.close))
+
+    def _add(self, link):
+        self.links[link.fd] = link
+        self.selector.register(link.fd, selectors.EVENT_READ, link)
+        metrics.count("links_opened")
+
+    def _close(self, link):
+        if link.closed:
+            return
+        link.closed = True
+        self.selector.unregister(link.fd)
+        del self.links[link.fd]
+        link.close()
+        for request in link.requests:
+            request.future.cancel()
+        metrics.count("links_closed")
+
+    def _watch(self, link):
+        """Watch for writability only while there is output."""
+        events = selectors.EVENT_READ
+        if link.outbuf:
+            events |= selectors.EVENT_WRITE
+        if events != link.events:
+            self.selector.modify(link.fd, events, link)
+            link.events = events
+
+    def _send(self, link, text):
+        link.outbuf += text.encode('ASCII')
+        self._flush(link)
+
+    def _flush(self, link):
+        if link.closed:
+            return
+        if link.outbuf:
+            try:
+                n = link.write(link.outbuf)
+                del link.outbuf[:n]
+            except (BlockingIOError, InterruptedError):
+                pass
+            except OSError:
+                self._close(link)
+                return
+        self._watch(link)
+
+    def _readable(self, link):
+        try:
+            data = link.read()
+        except (BlockingIOError, InterruptedError):
+            return
+        except OSError:
+            data = b""
+        if not data:
+            self._close(link)
+            return
+
+        link.inbuf += data
+        *lines, link.inbuf = link.inbuf.split(b"\n")
+        for raw in lines:
+            line = raw.decode('ASCII', 'replace').strip()
+            if line == "!":
+                # the client of the older protocol is out of room for
+                # the path; a late one after the path is done is dropped
+                if link.sending is not None:
+                    self._end_path(link, truncated=True)
+            elif line.startswith("X "):
+                try:
+                    self._cancel(link, int(line[2:]))
+                except ValueError:
+                    pass
+            elif line.startswith("R "):
+                tagged = parse_tagged_request(line)
+                if tagged is None:
+                    sys.stdout.write("0\n")
+                else:
+                    self._submit(link, *tagged)
+            elif line in QUIT_LINES:
+                self._close(link)
+                return
+            elif line:
+                self._point_line(link, line)
+
+    def _point_line(self, link, line):
+        """Make a request of every two point lines of the older protocol."""
+        if link.first_line_time is None:
+            link.first_line_time = time.perf_counter()
+        link.lines.append(line)
+        if len(link.lines) < 2:
+            return
+        line1 = link.lines.popleft()
+        line2 = link.lines.popleft()
+        # how long the link took to deliver both points
+        metrics.observe("read_points_us",
+                        (time.perf_counter() - link.first_line_time) * 1e6)
+        link.first_line_time = None
+
+        request = self.parse_request(line1, line2)
+        if request is None:
+            sys.stdout.write("0\n")
+            return
+        self._submit(link, None, request)
+
+    def _submit(self, link, id, points):
+        """Queue a request and start its search straight away."""
+        metrics.count("requests")
+        metrics.observe("requests_outstanding", len(link.requests))
+        request = Request(id)
+        link.requests.append(request)
+        request.future = self.pool.submit(self.search, points)
+        request.future.add_done_callback(
+            lambda f, link=link, request=request:
+                self._search_done(link, request))
+
+    def _cancel(self, link, id):
+        """
+        Drop the request id, or end its path if it is being sent.
+
+        A link over a socket pair, with searches that return a path
+        of points[1] vertices, the first one held until gate is set:
+
+        >>> import contextlib, io, socket, threading
+        >>> gate = threading.Event()
+        >>> def search(points):
+        ...     if points[0] == 1:
+        ...         gate.wait()
+        ...     return [(points[0], i) for i in range(points[1])]
+        >>> server = EventServer(search, None, threads=2, pace=0.05)
+        >>> ours, theirs = socket.socketpair()
+        >>> theirs.setblocking(False)
+        >>> server._add(Link("test", theirs.fileno(),
+        ...     lambda: theirs.recv(4096), theirs.send, theirs.close))
+        >>> def exchange(lines, seconds):
+        ...     ours.sendall(lines.encode())
+        ...     end = time.perf_counter() + seconds
+        ...     with contextlib.redirect_stdout(io.StringIO()):
+        ...         while time.perf_counter() < end:
+        ...             server.poll(0.01)
+        ...     ours.setblocking(False)
+        ...     try:
+        ...         return ours.recv(65536).decode()
+        ...     except BlockingIOError:
+        ...         return ""
+
+        Request 1 is cancelled while its search runs, and request 3
+        while it waits behind request 2, which is the only one
+        answered:
+
+        >>> print(exchange("R 1 1 2 0 0\\nR 2 2 2 0 0\\nR 3 3 2 0 0\\n"
+        ...                "X 3\\nX 1\\n", 0.3), end="")
+        N 2 2
+        2
+        0
+        2
+        1
+
+        The path of request 1, found after the cancel, is dropped:
+
+        >>> gate.set()
+        >>> exchange("", 0.1)
+        ''
+
+        Request 4 is cancelled while its path is being sent: the
+        path ends with "!" and request 5 behind it is answered.
+
+        >>> sent = exchange("R 4 4 1000 0 0\\nR 5 5 1 0 0\\n", 0.2)
+        >>> sent.split("\\n")[:3]
+        ['N 4 1000', '4', '0']
+        >>> print(exchange("X 4\\n", 0.2).split("!\\n")[1], end="")
+        N 5 1
+        5
+        0
+
+        A cancel for a request already answered is ignored.
+
+        >>> exchange("X 2\\n", 0.1)
+        ''
+        >>> server._close(server.links[theirs.fileno()])
+        >>> server.pool.shutdown()
+        """
+        for request in link.requests:
+            if request.id != id:
+                continue
+            metrics.count("requests_cancelled")
+            if request is link.requests[0] and link.sending is not None:
+                self._end_path(link, truncated=True)
+            else:
+                link.requests.remove(request)
+                request.future.cancel()
+            return
+
+    def _search_done(self, link, request):
+        """Runs on the pool thread: queue the result for the loop."""
+        self.done.append((link, request))
+        try:
+            os.write(self.wake_write, b"x")
+        except BlockingIOError:
+            # the loop has wake ups pending already
+            pass
+
+    def _finish_searches(self):
+        try:
+            while os.read(self.wake_read, 4096):
+                pass
+        except BlockingIOError:
+            pass
+        while self.done:
+            link, request = self.done.popleft()
+            if request.future.cancelled():
+                continue
+            try:
+                request.path = request.future.result()
+            except Exception as e:
+                sys.stderr.write("search for %s failed: %r\n" % (link.name, e))
+                request.path = []
+            if not link.closed:
+                self._next_path(link)
+
+    def _next_path(self, link):
+        """Start sending the first request's path once it is found."""
+        if link.sending is not None or not link.requests:
+            return
+        request = link.requests[0]
+        if request.path is None:
+            return
+        path = request.path
+        if request.id is None:
+            header = str(len(path))
+        else:
+            header = "N %d %d" % (request.id, len(path))
+        self._send(link, header + "\n")
+        sys.stdout.write(header + "\n")
+        link.send_start = time.perf_counter()
+        link.next_send = link.send_start
+        link.sending = collections.deque(path)
+        self._pump(link, time.perf_counter())
+
+    def _end_path(self, link, truncated=False):
+        if truncated:
+            self._send(link, "!\n")
+            sys.stdout.write("!\n")
+            metrics.count("paths_truncated")
+        link.sending = None
+        link.requests.popleft()
+        metrics.observe("transmit_us",
+                        (time.perf_counter() - link.send_start) * 1e6)
+        self._next_path(link)
+
+    def _pump(self, link, now):
+        """Release the vertices that are due and fit under HIGH_WATER."""
+        while (link.sending is not None and not link.closed
+               and now >= link.next_send and len(link.outbuf) < HIGH_WATER):
+            if link.sending:
+                lat, lon = link.sending.popleft()
+                sys.stdout.write(str(lat) + " " + str(lon) + "\n")
+                self._send(link, str(lat) + "\n" + str(lon) + "\n")
+                link.next_send = now + self.pace
+            if not link.sending:
+                # the path ends with its last vertex, so a cancel that
+                # comes after it finds nothing to cut short
+                self._end_path(link)
+                return
+
+    def _timeout(self, now):
+        """Seconds until the next vertex of any link is due."""
+        due = None
+        for link in self.links.values():
+            if link.sending is not None and len(link.outbuf) < HIGH_WATER:
+                wait = max(0.0, link.next_send - now)
+                due = wait if due is None else min(due, wait)
+        return due
+
+    def poll(self, timeout=None):
+        """
+        Wait once for events, no longer than timeout seconds (None
+        for as long as no vertex is due), handle them and release
+        the vertices that are due.
+        """
+        now = time.perf_counter()
+        due = self._timeout(now)
+        if timeout is not None:
+            due = timeout if due is None else min(due, timeout)
+        for key, events in self.selector.select(due):
+            if key.fileobj == self.wake_read:
+                self._finish_searches()
+            elif key.fd in self.listeners:
+                self._accept(self.listeners[key.fd])
+            else:
+                link = key.data
+                if link.closed:
+                    continue
+                if events & selectors.EVENT_WRITE:
+                    self._flush(link)
+                if events & selectors.EVENT_READ and not link.closed:
+                    self._readable(link)
+
+        now = time.perf_counter()
+        for link in list(self.links.values()):
+            if link.sending is not None:
+                self._pump(link, now)
+        sys.stdout.flush()
+
+    def run(self):
+        """
+        Serve until every link has been closed and there is no
+        listening socket.
+        """
+        while self.links or self.listeners:
+            self.poll()
+        self.pool.shutdown()
@@ -53,7 +53,28 @@ class Graph:
 
         for e in E:
             self.add_edge(e)
-        
+
+    @classmethod
+    def from_adjacency(cls, alist):
+        """
+        Create a graph from a dictionary mapping each vertex
+        to the list of its neighbours, all of which must be
+        vertices of the dictionary too. The dictionary is
+        taken over rather than copied, so loaders that build
+        the lists themselves skip adding edges one at a time.
+
+        Running time: O(1)
+
+        >>> g = Graph.from_adjacency({1: [2, 3], 2: [3], 3: []})
+        >>> g.vertices() == {1,2,3}
+        True
+        >>> g.edges()
+        [(1, 2), (1, 3), (2, 3)]
+        """
+        graph = cls()
+        graph._alist = alist
+        return graph
+
     def add_vertex(self, v):
         """
         Adds a vertex to our graph.
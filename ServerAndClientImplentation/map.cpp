@@ -3,6 +3,7 @@
 #include <Adafruit_ST7735.h> // Hardware-specific library
 #include "lcd_image.h"
 #include "map.h"
+#include "overlay.h"
 
 // #define DEBUG
 
@@ -124,16 +125,59 @@ int32_t y_to_latitude(char map_num, int32_t map_y) {
                  map_box[map_num].N, map_box[map_num].S);
 }
 
+/*
+    Forward projection from lat and lon to map pixels.  map() costs a
+    32-bit multiply and a 32-bit divide, which on the AVR is slow enough
+    to matter when a long path is projected, so instead the offset from
+    the NW corner is multiplied by the precomputed fixed-point scale for
+    the map.  An offset up to half a map span outside the map box keeps
+    the product inside an int32_t; anything further out falls back to map().
+*/
+
+const uint8_t map_proj_shift = 16;
+
+map_proj_t map_proj[6];
+
+void initialize_projection() {
+    for (uint8_t i = 0; i < num_maps; i++) {
+        map_proj[i].lon_span = map_box[i].E - map_box[i].W;
+        map_proj[i].lat_span = map_box[i].N - map_box[i].S;
+
+        // round the scales to nearest to halve the worst case pixel error
+        map_proj[i].x_scale =
+            (((uint32_t) map_x_limit[i] << map_proj_shift)
+                + map_proj[i].lon_span / 2) / map_proj[i].lon_span;
+        map_proj[i].y_scale =
+            (((uint32_t) map_y_limit[i] << map_proj_shift)
+                + map_proj[i].lat_span / 2) / map_proj[i].lat_span;
+        }
+    }
+
 int32_t longitude_to_x(char map_num, int32_t map_longitude) {
-    return map(map_longitude, 
-                 map_box[map_num].W, map_box[map_num].E,
-                 0, map_x_limit[map_num]);
+    int32_t offset = map_longitude - map_box[map_num].W;
+    int32_t span = map_proj[map_num].lon_span;
+
+    if ( offset < -span / 2 || offset > span + span / 2 ) {
+        return map(map_longitude, 
+                     map_box[map_num].W, map_box[map_num].E,
+                     0, map_x_limit[map_num]);
+        }
+
+    return (offset * map_proj[map_num].x_scale) >> map_proj_shift;
 }
 
 int32_t latitude_to_y(char map_num, int32_t map_latitude) {
-    return map(map_latitude, 
-                 map_box[map_num].N, map_box[map_num].S,
-                 0, map_y_limit[map_num]);
+    // latitude decreases going down the map, so measure down from N
+    int32_t offset = map_box[map_num].N - map_latitude;
+    int32_t span = map_proj[map_num].lat_span;
+
+    if ( offset < -span / 2 || offset > span + span / 2 ) {
+        return map(map_latitude, 
+                     map_box[map_num].N, map_box[map_num].S,
+                     0, map_y_limit[map_num]);
+        }
+
+    return (offset * map_proj[map_num].y_scale) >> map_proj_shift;
 }
 
 // zoom in and out routines that are used in interrupt handlers to
@@ -150,6 +194,8 @@ void initialize_map() {
     screen_map_x = 0;
     screen_map_y = 0;
 
+    initialize_projection();
+
     // set the actual map number from the shared version
     // this should be atomic and thus can be done outside a critical section
     current_map_num = shared_new_map_num;
@@ -248,6 +294,13 @@ void draw_cursor() {
     uint16_t cursor_screen_x;
     uint16_t cursor_screen_y;
     if ( get_cursor_screen_x_y(&cursor_screen_x, &cursor_screen_y) ) {
+        // keep the map under the cursor so erase_cursor can put it back
+        overlay_cache_map(
+            cursor_map_x - dot_radius,
+            cursor_map_y - dot_radius,
+            2 * dot_radius + 1,
+            2 * dot_radius + 1);
+
         cursor_screen_x = cursor_map_x - screen_map_x;
         cursor_screen_y = cursor_map_y - screen_map_y;
         tft.fillCircle(cursor_screen_x, cursor_screen_y, dot_radius, RED);
@@ -258,10 +311,8 @@ void erase_cursor() {
     uint16_t cursor_screen_x;
     uint16_t cursor_screen_y;
     if ( get_cursor_screen_x_y(&cursor_screen_x, &cursor_screen_y) ) {
-        // Redraw the map on top of the current cursor position
-        lcd_image_draw(&map_tiles[current_map_num], &tft,
-            cursor_map_x - dot_radius,
-            cursor_map_y - dot_radius,
+        // Redraw the map, and whatever was on it, under the cursor
+        overlay_repaint(
             cursor_screen_x - dot_radius,
             cursor_screen_y - dot_radius,
             2 * dot_radius + 1,
@@ -53,6 +53,25 @@ typedef struct {
 
 extern map_box_t map_box[];
 
+/*
+    Fixed-point projection constants for one map (zoom level), derived
+    from map_box and map_x_limit/map_y_limit by initialize_projection().
+    The scales are pixels per unit of lon or lat, shifted left by
+    map_proj_shift, so that a lat or lon is projected with one 32-bit
+    multiply and a shift instead of the multiply and divide in map().
+*/
+typedef struct {
+    int32_t x_scale;    // pixels per unit of longitude << map_proj_shift
+    int32_t y_scale;    // pixels per unit of latitude << map_proj_shift
+    int32_t lon_span;   // E - W
+    int32_t lat_span;   // N - S
+} map_proj_t;
+
+extern const uint8_t map_proj_shift;
+extern map_proj_t map_proj[];
+
+void initialize_projection();
+
 // conversion routines between lat and long and map pixel coordinates
 int32_t x_to_longitude(char map_num, int32_t map_x);
 int32_t y_to_latitude(char map_num, int32_t map_y);
@@ -0,0 +1,232 @@
+"""
+Latency histograms and counters for the route server.
+
+Every thread records into its own set of histograms and counters,
+found through threading.local, so recording never takes a lock and
+never contends with other threads. A scrape of the metrics endpoint
+merges the per-thread sets into one.
+
+Histograms are HDR style: values, in microseconds, are counted in
+buckets that are linear within each power of two. Each power of
+two has SUB_BUCKETS/2 buckets, so a bucket is 2/SUB_BUCKETS of the
+smallest value in it wide and every value is kept to within about
+6% of its size, from 1 us to hours, in a few hundred buckets.
+
+Usage:
+    import metrics
+    metrics.start_server(9100)
+    with metrics.timed("least_cost_path"):
+        ...
+    metrics.count("closest_cache_hit")
+    metrics.observe("settled_nodes", n)
+
+and then fetch http://127.0.0.1:9100/metrics.
+"""
+import threading
+import time
+from http.server import BaseHTTPRequestHandler, HTTPServer
+
+SUB_BUCKET_BITS = 5
+SUB_BUCKETS = 1 << SUB_BUCKET_BITS
+
+def bucket_index(value):
+    """
+    The bucket that holds the non-negative integer value.
+    Values below SUB_BUCKETS get a bucket each, and each power
+    of two above that is split into SUB_BUCKETS/2 buckets.
+
+    >>> [bucket_index(v) for v in (0, 1, 31, 32, 33, 34, 64, 68)]
+    [0, 1, 31, 32, 32, 33, 48, 49]
+    """
+    if value < SUB_BUCKETS:
+        return value
+    shift = value.bit_length() - SUB_BUCKET_BITS
+    return (shift + 1) * (SUB_BUCKETS // 2) + (value >> shift) - SUB_BUCKETS // 2
+
+def bucket_value(index):
+    """
+    The largest value held in bucket index, which is what a
+    percentile falling in that bucket reports.
+
+    >>> [bucket_value(i) for i in (0, 31, 32, 33, 48)]
+    [0, 31, 33, 35, 67]
+    """
+    if index < SUB_BUCKETS:
+        return index
+    shift = index // (SUB_BUCKETS // 2) - 1
+    sub = index % (SUB_BUCKETS // 2) + SUB_BUCKETS // 2
+    return ((sub + 1) << shift) - 1
+
+class Histogram:
+    """
+    Counts of integer values in log-linear buckets.
+
+    >>> h = Histogram()
+    >>> for v in range(1, 101):
+    ...     h.record(v)
+    >>> h.count, h.total, h.max
+    (100, 5050, 100)
+    >>> h.percentile(0.5), h.percentile(0.99)
+    (51, 99)
+    """
+    def __init__(self):
+        self.buckets = {}
+        self.count = 0
+        self.total = 0
+        self.max = 0
+
+    def record(self, value):
+        value = int(value)
+        i = bucket_index(value)
+        self.buckets[i] = self.buckets.get(i, 0) + 1
+        self.count += 1
+        self.total += value
+        if value > self.max:
+            self.max = value
+
+    def merge(self, other):
+        for i, n in list(other.buckets.items()):
+            self.buckets[i] = self.buckets.get(i, 0) + n
+        self.count += other.count
+        self.total += other.total
+        self.max = max(self.max, other.max)
+
+    def percentile(self, q):
+        """
+        The value at fraction q of the recorded values, to within
+        the bucket resolution, and never more than the maximum.
+        """
+        if self.count == 0:
+            return 0
+        rank = q * self.count
+        seen = 0
+        for i in sorted(self.buckets):
+            seen += self.buckets[i]
+            if seen >= rank:
+                return min(bucket_value(i), self.max)
+        return self.max
+
+class _ThreadMetrics:
+    """
+    The histograms and counters written by one thread.
+    """
+    def __init__(self):
+        self.histograms = {}
+        self.counters = {}
+
+_local = threading.local()
+_all_threads = []
+_register_lock = threading.Lock()
+
+def _mine():
+    """
+    The metrics of the calling thread, registered on first use
+    so a scrape can find them. Only registering takes a lock.
+    """
+    mine = getattr(_local, "metrics", None)
+    if mine is None:
+        mine = _ThreadMetrics()
+        with _register_lock:
+            _all_threads.append(mine)
+        _local.metrics = mine
+    return mine
+
+def observe(name, value):
+    """
+    Record value in the histogram name.
+    """
+    histograms = _mine().histograms
+    h = histograms.get(name)
+    if h is None:
+        h = histograms[name] = Histogram()
+    h.record(value)
+
+def count(name, n=1):
+    """
+    Add n to the counter name.
+    """
+    counters = _mine().counters
+    counters[name] = counters.get(name, 0) + n
+
+class timed:
+    """
+    Context manager that records the time spent in its body,
+    in microseconds, in the histogram name + "_us".
+    """
+    def __init__(self, name):
+        self.name = name + "_us"
+
+    def __enter__(self):
+        self.start = time.perf_counter()
+        return self
+
+    def __exit__(self, *exc):
+        observe(self.name, (time.perf_counter() - self.start) * 1e6)
+        return False
+
+def snapshot():
+    """
+    Merge the metrics of all threads into one set of histograms
+    and one set of counters.
+    """
+    histograms = {}
+    counters = {}
+    with _register_lock:
+        threads = list(_all_threads)
+    for t in threads:
+        for name, h in list(t.histograms.items()):
+            histograms.setdefault(name, Histogram()).merge(h)
+        for name, n in list(t.counters.items()):
+            counters[name] = counters.get(name, 0) + n
+    return histograms, counters
+
+PERCENTILES = (0.5, 0.9, 0.99, 0.999)
+
+def render():
+    """
+    The merged metrics in the Prometheus text format, with each
+    histogram given as a summary of a few percentiles.
+
+    >>> count("render_test_total", 3)
+    >>> "render_test_total 3" in render()
+    True
+    """
+    histograms, counters = snapshot()
+    lines = []
+    for name in sorted(histograms):
+        h = histograms[name]
+        lines.append("# TYPE %s summary" % name)
+        for q in PERCENTILES:
+            lines.append('%s{quantile="%g"} %d' % (name, q, h.percentile(q)))
+        lines.append("%s_max %d" % (name, h.max))
+        lines.append("%s_sum %d" % (name, h.total))
+        lines.append("%s_count %d" % (name, h.count))
+    for name in sorted(counters):
+        lines.append("# TYPE %s counter" % name)
+        lines.append("%s %d" % (name, counters[name]))
+    return "\n".join(lines) + "\n"
+
+class _Handler(BaseHTTPRequestHandler):
+    def do_GET(self):
+        if self.path != "/metrics":
+            self.send_error(404)
+            return
+        body = render().encode("ASCII")
+        self.send_response(200)
+        self.send_header("Content-Type", "text/plain; version=0.0.4")
+        self.send_header("Content-Length", str(len(body)))
+        self.end_headers()
+        self.wfile.write(body)
+
+    def log_message(self, format, *args):
+        pass
+
+def start_server(port, host="127.0.0.1"):
+    """
+    Serve the metrics at http://host:port/metrics from a daemon
+    thread. Only the local host can connect by default.
+    """
+    server = HTTPServer((host, port), _Handler)
+    thread = threading.Thread(target=server.serve_forever, daemon=True)
+    thread.start()
+    return server
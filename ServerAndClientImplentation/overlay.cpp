@@ -0,0 +1,202 @@
+#include <Arduino.h>
+#include <Adafruit_ST7735.h>
+#include <SD.h>
+#include "lcd_image.h"
+
+#include "map.h"
+#include "overlay.h"
+#include "path.h"
+
+/*
+    Module to repaint the parts of the screen that are drawn over the map.
+
+    The map is a window onto a tile on the SD card, and the cursor, path
+    and status bar are drawn on top of it.  When the cursor moves, the map
+    under its old position has to be put back, and that used to mean
+    reading the patch from the SD card on every joystick move and leaving
+    a hole in any path underneath.
+
+    Instead a window of tile pixels around the cursor is kept in
+    map_cache.  Erasing the cursor restores the damaged rectangle from the
+    window and redraws the overlay primitives, the path and the status
+    bar, clipped to that rectangle.
+
+    The window is a ring buffer: map pixel (x, y) lives at row y mod
+    map_cache_rows and column x mod map_cache_cols, so when the cursor
+    leaves it the window slides and only the pixels it newly covers are
+    read.  Reading from the card costs about one block per tile row
+    touched, so the two directions are treated differently.  A vertical
+    slide reads one row per pixel moved, so the window slides only as far
+    as the cursor went.  A horizontal slide reads a piece of every row
+    whatever its length, so the window jumps to put the cursor at its
+    trailing edge, leaving it most of a window width to cross before the
+    next read.  The window is short and wide for the same reason, and
+    moving the cursor reads fewer rows than the 5 per move of drawing the
+    patch straight from the tile.
+*/
+
+extern Adafruit_ST7735 tft;
+extern lcd_image_t map_tiles[];
+
+// redraws the status bar, defined with the status messages in client.cpp
+void redraw_status_msg();
+
+const uint16_t status_bar_top = 148;
+const uint16_t status_bar_height = 12;
+
+// the window of tile pixels, as stored in the tile; the sizes are powers
+// of two so the ring positions are masks
+const uint16_t map_cache_cols = 32;
+const uint16_t map_cache_rows = 8;
+uint16_t map_cache[map_cache_rows * map_cache_cols];
+
+// the map position of the top left of the window, and the map it is from
+uint16_t map_cache_x;
+uint16_t map_cache_y;
+const uint8_t no_cache_map = 0xFF;
+uint8_t map_cache_map_num = no_cache_map;
+
+// the pixel of map position (x, y) in the ring
+uint16_t *map_cache_pixel(uint16_t x, uint16_t y) {
+    return &map_cache[(y & (map_cache_rows - 1)) * map_cache_cols
+        + (x & (map_cache_cols - 1))];
+    }
+
+uint8_t map_cache_covers(uint16_t map_x, uint16_t map_y,
+    uint16_t width, uint16_t height) {
+    return map_cache_map_num == current_map_num &&
+        map_cache_x <= map_x &&
+        map_x + width <= map_cache_x + map_cache_cols &&
+        map_cache_y <= map_y &&
+        map_y + height <= map_cache_y + map_cache_rows;
+    }
+
+/*
+    Read count pixels of tile row y starting at column x into the ring.
+  They are contiguous in the file, so there is one seek, and at most two
+  reads where the ring wraps.
+*/
+void map_cache_read(File &file, lcd_image_t *tile, uint16_t x, uint16_t y,
+    uint16_t count) {
+    // each pixel is 2 bytes, and each row of the tile is ncols pixels
+    file.seek(2 * ((uint32_t) y * tile->ncols + x));
+    while ( count > 0 ) {
+        uint16_t n = min(count, map_cache_cols - (x & (map_cache_cols - 1)));
+        file.read(map_cache_pixel(x, y), 2 * n);
+        x += n;
+        count -= n;
+        }
+    }
+
+void overlay_cache_map(uint16_t map_x, uint16_t map_y,
+    uint16_t width, uint16_t height) {
+    if ( map_cache_covers(map_x, map_y, width, height) ) {
+        return;
+        }
+
+    int32_t x = map_cache_x;
+    int32_t y = map_cache_y;
+    uint8_t refill = map_cache_map_num != current_map_num;
+    if ( refill ) {
+        // a new map: centre the window on the rectangle
+        x = (int32_t) map_x + width / 2 - map_cache_cols / 2;
+        y = (int32_t) map_y + height / 2 - map_cache_rows / 2;
+        }
+    else {
+        // jump across so the rectangle is at the trailing edge
+        if ( map_x < x ) {
+            x = (int32_t) map_x + width - map_cache_cols;
+            }
+        else if ( map_x + width > x + map_cache_cols ) {
+            x = map_x;
+            }
+        // slide just far enough
+        if ( map_y < y ) {
+            y = map_y;
+            }
+        else if ( map_y + height > y + map_cache_rows ) {
+            y = (int32_t) map_y + height - map_cache_rows;
+            }
+        }
+
+    // keep the window on the map
+    x = constrain(x, 0,
+        (int32_t) map_x_limit[current_map_num] + 1 - map_cache_cols);
+    y = constrain(y, 0,
+        (int32_t) map_y_limit[current_map_num] + 1 - map_cache_rows);
+
+    lcd_image_t *tile = &map_tiles[current_map_num];
+    File file = SD.open(tile->file_name);
+    if ( !file ) {
+        map_cache_map_num = no_cache_map;
+        return;
+        }
+
+    uint16_t old_x = map_cache_x;
+    uint16_t old_y = map_cache_y;
+    if ( refill || abs(x - (int32_t) old_x) >= map_cache_cols
+         || abs(y - (int32_t) old_y) >= map_cache_rows ) {
+        old_x = x;
+        old_y = y;
+        refill = 1;
+        }
+
+    for (uint16_t row = y; row < y + map_cache_rows; row++) {
+        if ( refill || row < old_y || row >= old_y + map_cache_rows ) {
+            // a row the window did not have
+            map_cache_read(file, tile, x, row, map_cache_cols);
+            }
+        else if ( x < old_x ) {
+            map_cache_read(file, tile, x, row, old_x - x);
+            }
+        else if ( x > old_x ) {
+            map_cache_read(file, tile, old_x + map_cache_cols, row, x - old_x);
+            }
+        }
+    file.close();
+
+    map_cache_x = x;
+    map_cache_y = y;
+    map_cache_map_num = current_map_num;
+    }
+
+void overlay_repaint(int16_t screen_x, int16_t screen_y,
+    uint16_t width, uint16_t height) {
+    // keep the rectangle on the screen
+    int16_t right = min(screen_x + (int16_t) width,
+        (int16_t) display_window_width) - 1;
+    int16_t bottom = min(screen_y + (int16_t) height,
+        (int16_t) display_window_height) - 1;
+    screen_x = max(screen_x, 0);
+    screen_y = max(screen_y, 0);
+    if ( right < screen_x || bottom < screen_y ) {
+        return;
+        }
+    width = right - screen_x + 1;
+    height = bottom - screen_y + 1;
+
+    uint16_t map_x = screen_map_x + screen_x;
+    uint16_t map_y = screen_map_y + screen_y;
+
+    if ( map_cache_covers(map_x, map_y, width, height) ) {
+        // the tile stores each pixel high byte first, the order the
+        // display takes them in, so swap them back into a colour
+        tft.setAddrWindow(screen_x, screen_y, right, bottom);
+        for (uint16_t row = 0; row < height; row++) {
+            for (uint16_t col = 0; col < width; col++) {
+                uint16_t pixel = *map_cache_pixel(map_x + col, map_y + row);
+                tft.pushColor((pixel << 8) | (pixel >> 8));
+                }
+            }
+        }
+    else {
+        lcd_image_draw(&map_tiles[current_map_num], &tft,
+            map_x, map_y, screen_x, screen_y, width, height);
+        }
+
+    draw_path_in(map_x, map_y, map_x + width - 1, map_y + height - 1);
+
+    if ( bottom >= (int16_t) status_bar_top ) {
+        redraw_status_msg();
+        }
+    }
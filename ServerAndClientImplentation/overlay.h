@@ -0,0 +1,38 @@
+/*
+ Repainting of the things drawn over the map: the cursor, the path and
+ the status bar.  A small window of map tile pixels around the cursor is
+ kept in memory so that moving the cursor can repair the map under it
+ from there, reading only the pixels the window newly covers from the SD
+ card.
+ */
+
+#ifndef OVERLAY_H
+#define OVERLAY_H
+
+#include <stdint.h>
+
+// the status bar across the bottom of the screen, in screen coordinates
+extern const uint16_t status_bar_top;
+extern const uint16_t status_bar_height;
+
+/*
+    Make sure the map pixels of the rectangle with top left (map_x, map_y)
+  and the given size, in map coordinates on the current map, are in the
+  cache, sliding the window over it and reading the pixels it newly
+  covers from the SD card if they are not.
+  Call before drawing something over that part of the map so that it can
+  be repaired later by overlay_repaint.
+*/
+void overlay_cache_map(uint16_t map_x, uint16_t map_y,
+    uint16_t width, uint16_t height);
+
+/*
+    Repair the damaged screen rectangle with top left (screen_x, screen_y)
+  and the given size: the map under it is restored, from the cache when it
+  covers the rectangle and from the SD card otherwise, and then the path
+  and status bar are redrawn clipped to it.
+*/
+void overlay_repaint(int16_t screen_x, int16_t screen_y,
+    uint16_t width, uint16_t height);
+
+#endif
@@ -0,0 +1,455 @@
+#include <Arduino.h>
+#include <Adafruit_ST7735.h>
+
+#include "map.h"
+#include "path.h"
+
+/*
+    Module to hold the path sent by the server and draw it on the map.
+
+    The server sends the path as a list of lat and lon vertices.  Drawing
+    needs them in map pixel coordinates for the current zoom level, and
+    projecting is by far the most expensive part of a redraw, so the pixel
+    positions are computed once, when the path arrives or the zoom changes,
+    and kept in path_pixels until then.  Map pixel coordinates are at most
+    16383 so they fit in 16 bits.
+
+    Both the vertices and their pixel positions are kept in fixed arenas
+    as differences from the previous vertex, which takes about 6 bytes a
+    vertex instead of the 12 needed for the full values.  A path longer
+    than the arena holds is truncated.
+
+    Only the part of the path inside the display window is drawn.  The
+    bounding box of the whole path is kept with the projection so a path
+    entirely off screen costs nothing, and each segment is clipped to the
+    window (Cohen-Sutherland) before it is handed to tft.drawLine, which
+    would otherwise rasterize every pixel of a long off-screen line.
+*/
+
+extern Adafruit_ST7735 tft;
+
+uint16_t path_num_vertices = 0;
+
+/*
+    The lat and lon of the vertices, in a statically reserved arena so that
+    receiving a path never touches the heap.  The first vertex is stored as
+    two int32_t, and every other vertex as two int16_t differences from the
+    vertex before it.  Consecutive vertices are a road segment apart, so the
+    differences nearly always fit; when one does not, path_geo_escape is
+    stored followed by the vertex as two int32_t.
+*/
+const uint16_t path_geo_size = 2048;
+uint8_t path_geo[path_geo_size];
+uint16_t path_geo_len = 0;
+const int16_t path_geo_escape = -32768;
+
+// the vertex most recently added, which the next difference is taken from
+int32_t path_last_lat;
+int32_t path_last_lon;
+
+/*
+    The pixel positions of the vertices on map path_proj_map_num, packed
+    the same way: two int16_t for the first vertex, then two int8_t
+    differences, or path_pixel_escape followed by two int16_t.  If the
+    projection onto a map does not fit, path_pixels_fit is cleared and the
+    vertices are projected as they are drawn instead.
+*/
+const uint16_t path_pixel_size = 1024;
+uint8_t path_pixels[path_pixel_size];
+uint16_t path_pixel_len = 0;
+const int8_t path_pixel_escape = -128;
+uint8_t path_pixels_fit = 1;
+
+// the map that path_pixels was projected onto, or no_proj_map
+const uint8_t no_proj_map = 0xFF;
+uint8_t path_proj_map_num = no_proj_map;
+
+// the bounding box of the projected path
+int16_t path_min_x;
+int16_t path_min_y;
+int16_t path_max_x;
+int16_t path_max_y;
+
+// the last two projected vertices, for drawing the newest segment
+int16_t path_prev_x;
+int16_t path_prev_y;
+int16_t path_last_x;
+int16_t path_last_y;
+
+/*
+    Append n bytes from data to the arena buf of size bytes, of which *len
+  are in use.  Returns 0, and appends nothing, if they do not fit.
+*/
+uint8_t arena_put(uint8_t *buf, uint16_t size, uint16_t *len,
+    const void *data, uint8_t n) {
+    if ( *len + n > size ) {
+        return 0;
+        }
+    memcpy(buf + *len, data, n);
+    *len += n;
+    return 1;
+    }
+
+// read n bytes into data from buf at *pos and move past them
+void arena_get(const uint8_t *buf, uint16_t *pos, void *data, uint8_t n) {
+    memcpy(data, buf + *pos, n);
+    *pos += n;
+    }
+
+void path_clear() {
+    path_num_vertices = 0;
+    path_geo_len = 0;
+    path_pixel_len = 0;
+    path_pixels_fit = 1;
+
+    // an empty path is already projected onto every map
+    path_proj_map_num = current_map_num;
+    }
+
+uint8_t path_add_geo(int32_t lat, int32_t lon) {
+    int32_t dlat = lat - path_last_lat;
+    int32_t dlon = lon - path_last_lon;
+
+    if ( path_geo_len > 0 &&
+         dlat > path_geo_escape && dlat <= 32767 &&
+         dlon > path_geo_escape && dlon <= 32767 ) {
+        int16_t d[2] = { (int16_t) dlat, (int16_t) dlon };
+        return arena_put(path_geo, path_geo_size, &path_geo_len, d, 4);
+        }
+
+    int32_t v[2] = { lat, lon };
+    uint16_t need = path_geo_len > 0 ? sizeof(path_geo_escape) + 8 : 8;
+    if ( path_geo_len + need > path_geo_size ) {
+        return 0;
+        }
+    if ( path_geo_len > 0 ) {
+        arena_put(path_geo, path_geo_size, &path_geo_len,
+            &path_geo_escape, sizeof(path_geo_escape));
+        }
+    return arena_put(path_geo, path_geo_size, &path_geo_len, v, 8);
+    }
+
+// decode the vertex at *pos, which follows (*lat, *lon)
+void path_get_geo(uint16_t *pos, int32_t *lat, int32_t *lon) {
+    if ( *pos > 0 ) {
+        int16_t d;
+        arena_get(path_geo, pos, &d, 2);
+        if ( d != path_geo_escape ) {
+            *lat += d;
+            arena_get(path_geo, pos, &d, 2);
+            *lon += d;
+            return;
+            }
+        }
+    arena_get(path_geo, pos, lat, 4);
+    arena_get(path_geo, pos, lon, 4);
+    }
+
+// append the pixel position of the next vertex, which follows path_last_x/y
+void path_add_pixel(uint16_t i, int16_t x, int16_t y) {
+    int16_t dx = x - path_last_x;
+    int16_t dy = y - path_last_y;
+
+    if ( !path_pixels_fit ) {
+        return;
+        }
+
+    if ( i > 0 && dx > path_pixel_escape && dx <= 127 &&
+         dy > path_pixel_escape && dy <= 127 ) {
+        int8_t d[2] = { (int8_t) dx, (int8_t) dy };
+        path_pixels_fit =
+            arena_put(path_pixels, path_pixel_size, &path_pixel_len, d, 2);
+        return;
+        }
+
+    int16_t v[2] = { x, y };
+    uint16_t need = i > 0 ? sizeof(path_pixel_escape) + 4 : 4;
+    if ( path_pixel_len + need > path_pixel_size ) {
+        path_pixels_fit = 0;
+        return;
+        }
+    if ( i > 0 ) {
+        arena_put(path_pixels, path_pixel_size, &path_pixel_len,
+            &path_pixel_escape, sizeof(path_pixel_escape));
+        }
+    arena_put(path_pixels, path_pixel_size, &path_pixel_len, v, 4);
+    }
+
+// decode the pixel position at *pos, which follows (*x, *y)
+void path_get_pixel(uint16_t *pos, int16_t *x, int16_t *y) {
+    if ( *pos > 0 ) {
+        int8_t d;
+        arena_get(path_pixels, pos, &d, 1);
+        if ( d != path_pixel_escape ) {
+            *x += d;
+            arena_get(path_pixels, pos, &d, 1);
+            *y += d;
+            return;
+            }
+        }
+    arena_get(path_pixels, pos, x, 2);
+    arena_get(path_pixels, pos, y, 2);
+    }
+
+// vertices far off the map are pinned to this range, which keeps them in
+// 16 bits and keeps the products in clip_line inside 32 bits
+const int16_t path_pixel_min = -8192;
+const int16_t path_pixel_max = 24575;
+
+// project a vertex onto map map_num
+void project_point(uint8_t map_num, int32_t lat, int32_t lon,
+    int16_t *x, int16_t *y) {
+    *x = constrain(longitude_to_x(map_num, lon), path_pixel_min, path_pixel_max);
+    *y = constrain(latitude_to_y(map_num, lat), path_pixel_min, path_pixel_max);
+    }
+
+// project vertex i onto map map_num, cache it and grow the bounding box
+void project_vertex(uint16_t i, uint8_t map_num, int32_t lat, int32_t lon) {
+    int16_t x;
+    int16_t y;
+    project_point(map_num, lat, lon, &x, &y);
+
+    path_add_pixel(i, x, y);
+    path_prev_x = path_last_x;
+    path_prev_y = path_last_y;
+    path_last_x = x;
+    path_last_y = y;
+
+    if ( i == 0 || x < path_min_x ) path_min_x = x;
+    if ( i == 0 || x > path_max_x ) path_max_x = x;
+    if ( i == 0 || y < path_min_y ) path_min_y = y;
+    if ( i == 0 || y > path_max_y ) path_max_y = y;
+    }
+
+uint8_t path_add_vertex(int32_t lat, int32_t lon) {
+    if ( !path_add_geo(lat, lon) ) {
+        return 0;
+        }
+    path_last_lat = lat;
+    path_last_lon = lon;
+
+    // keep the cache up to date so the new segment can be drawn at once
+    if ( path_proj_map_num != no_proj_map ) {
+        project_vertex(path_num_vertices, path_proj_map_num, lat, lon);
+        }
+
+    path_num_vertices++;
+    return 1;
+    }
+
+void path_project(uint8_t map_num) {
+    if ( path_proj_map_num == map_num ) {
+        return;
+        }
+
+    path_pixel_len = 0;
+    path_pixels_fit = 1;
+
+    uint16_t pos = 0;
+    int32_t lat = 0;
+    int32_t lon = 0;
+    for (uint16_t i = 0; i < path_num_vertices; i++) {
+        path_get_geo(&pos, &lat, &lon);
+        project_vertex(i, map_num, lat, lon);
+        }
+
+    path_proj_map_num = map_num;
+    }
+
+/*
+    Walks the path in order giving the pixel position of each vertex on
+    the current map, from the cache if it holds the whole projection and
+    by projecting the stored lat and lon otherwise.
+*/
+typedef struct {
+    uint16_t geo_pos;
+    uint16_t pixel_pos;
+    int32_t lat;
+    int32_t lon;
+    int16_t x;
+    int16_t y;
+} path_iter_t;
+
+void path_iter_start(path_iter_t *it) {
+    it->geo_pos = 0;
+    it->pixel_pos = 0;
+    it->lat = 0;
+    it->lon = 0;
+    it->x = 0;
+    it->y = 0;
+    }
+
+void path_iter_next(path_iter_t *it) {
+    if ( path_pixels_fit ) {
+        path_get_pixel(&it->pixel_pos, &it->x, &it->y);
+        }
+    else {
+        path_get_geo(&it->geo_pos, &it->lat, &it->lon);
+        project_point(current_map_num, it->lat, it->lon, &it->x, &it->y);
+        }
+    }
+
+// Cohen-Sutherland outcodes, one bit per side of the clip rectangle
+const uint8_t clip_left = 1;
+const uint8_t clip_right = 2;
+const uint8_t clip_top = 4;
+const uint8_t clip_bottom = 8;
+
+uint8_t clip_outcode(int32_t x, int32_t y,
+    int16_t left, int16_t top, int16_t right, int16_t bottom) {
+    uint8_t code = 0;
+
+    if ( x < left ) code |= clip_left;
+    else if ( x > right ) code |= clip_right;
+
+    if ( y < top ) code |= clip_top;
+    else if ( y > bottom ) code |= clip_bottom;
+
+    return code;
+    }
+
+/*
+    Clip the line from (x0, y0) to (x1, y1) to the rectangle with corners
+  (left, top) and (right, bottom), inclusive.  Returns 1 and updates the
+  end points if part of the line is inside, and 0 if none of it is.
+*/
+uint8_t clip_line(int32_t *x0, int32_t *y0, int32_t *x1, int32_t *y1,
+    int16_t left, int16_t top, int16_t right, int16_t bottom) {
+    uint8_t code0 = clip_outcode(*x0, *y0, left, top, right, bottom);
+    uint8_t code1 = clip_outcode(*x1, *y1, left, top, right, bottom);
+
+    while (1) {
+        if ( !(code0 | code1) ) {
+            // both ends inside
+            return 1;
+            }
+        if ( code0 & code1 ) {
+            // both ends beyond the same side
+            return 0;
+            }
+
+        // move the end that is outside onto the side it is beyond
+        uint8_t code = code0 ? code0 : code1;
+        int32_t x;
+        int32_t y;
+        int32_t dx = *x1 - *x0;
+        int32_t dy = *y1 - *y0;
+
+        if ( code & clip_top ) {
+            x = *x0 + dx * (top - *y0) / dy;
+            y = top;
+            }
+        else if ( code & clip_bottom ) {
+            x = *x0 + dx * (bottom - *y0) / dy;
+            y = bottom;
+            }
+        else if ( code & clip_left ) {
+            y = *y0 + dy * (left - *x0) / dx;
+            x = left;
+            }
+        else {
+            y = *y0 + dy * (right - *x0) / dx;
+            x = right;
+            }
+
+        if ( code == code0 ) {
+            *x0 = x;
+            *y0 = y;
+            code0 = clip_outcode(x, y, left, top, right, bottom);
+            }
+        else {
+            *x1 = x;
+            *y1 = y;
+            code1 = clip_outcode(x, y, left, top, right, bottom);
+            }
+        }
+    }
+
+/*
+    Draw the segment from (x0, y0) to (x1, y1) in map coordinates, clipped
+  to the rectangle with corners (left, top) and (right, bottom) in map
+  coordinates, which must lie inside the display window.  Returns 1 if any
+  of it was visible.
+*/
+uint8_t draw_segment(int32_t x0, int32_t y0, int32_t x1, int32_t y1,
+    int16_t left, int16_t top, int16_t right, int16_t bottom) {
+    if ( !clip_line(&x0, &y0, &x1, &y1, left, top, right, bottom) ) {
+        return 0;
+        }
+
+    // the screen position of a vertex is its map position less the
+    // position of the display window
+    tft.drawLine(x0 - screen_map_x, y0 - screen_map_y,
+        x1 - screen_map_x, y1 - screen_map_y, RED);
+    return 1;
+    }
+
+/*
+This function will take the shortest path and draw it the map
+*/
+void draw_path() {
+    draw_path_in(screen_map_x, screen_map_y,
+        screen_map_x + display_window_width - 1,
+        screen_map_y + display_window_height - 1);
+    }
+
+void draw_path_in(int16_t left, int16_t top, int16_t right, int16_t bottom) {
+    path_project(current_map_num);
+
+    if ( path_num_vertices == 0 ) {
+        return;
+        }
+
+    // nothing to do if the whole path is outside the rectangle
+    if ( path_max_x < left || path_min_x > right ||
+         path_max_y < top || path_min_y > bottom ) {
+        return;
+        }
+
+    path_iter_t it;
+    path_iter_start(&it);
+    path_iter_next(&it);
+    for (uint16_t i = 1; i < path_num_vertices; i++) {
+        int16_t x0 = it.x;
+        int16_t y0 = it.y;
+        path_iter_next(&it);
+        draw_segment(x0, y0, it.x, it.y, left, top, right, bottom);
+        }
+    }
+
+const uint8_t *path_packed(uint16_t *len) {
+    *len = path_geo_len;
+    return path_geo;
+    }
+
+uint8_t *path_load_start(uint16_t len) {
+    path_clear();
+    if ( len > path_geo_size ) {
+        return 0;
+        }
+    path_geo_len = len;
+    return path_geo;
+    }
+
+void path_load_finish(uint16_t num_vertices) {
+    // find the last vertex, which the next one added would follow
+    uint16_t pos = 0;
+    for (uint16_t i = 0; i < num_vertices; i++) {
+        path_get_geo(&pos, &path_last_lat, &path_last_lon);
+        }
+    path_num_vertices = num_vertices;
+    path_proj_map_num = no_proj_map;
+    }
+
+uint8_t draw_path_last_segment() {
+    if ( path_num_vertices < 2 ) {
+        return 0;
+        }
+
+    path_project(current_map_num);
+
+    return draw_segment(path_prev_x, path_prev_y, path_last_x, path_last_y,
+        screen_map_x, screen_map_y,
+        screen_map_x + display_window_width - 1,
+        screen_map_y + display_window_height - 1);
+    }
@@ -0,0 +1,73 @@
+/*
+ Storage and drawing of the shortest path received from the server.
+ The path is kept as lat and lon pairs in a fixed size arena, together
+ with a cache of the pixel positions of its vertices on one map so that
+ redraws do not have to project every vertex again.
+ */
+
+#ifndef PATH_H
+#define PATH_H
+
+#include <stdint.h>
+
+// number of vertices stored in the current path, 0 if there is none
+extern uint16_t path_num_vertices;
+
+/*
+    Discard the current path to start receiving a new one.
+*/
+void path_clear();
+
+/*
+    Append a vertex to the path.  If the pixel cache is valid the new
+  vertex is projected onto the same map, so the cache stays valid.
+
+  Returns: 1 if the vertex was stored, and 0 if the path storage is full,
+    in which case the path ends at the vertex before.
+*/
+uint8_t path_add_vertex(int32_t lat, int32_t lon);
+
+/*
+    Project every vertex of the path onto map map_num and keep the
+  resulting pixel positions.  Nothing is done if the cache already holds
+  the projection for that map.
+*/
+void path_project(uint8_t map_num);
+
+/*
+    Draw the path over the current display window, projecting it onto
+  the current map first if the zoom has changed since the last draw.
+*/
+void draw_path();
+
+/*
+    Draw only the part of the path inside the rectangle with corners
+  (left, top) and (right, bottom), in map coordinates, for repairing a
+  small damaged part of the display window.
+*/
+void draw_path_in(int16_t left, int16_t top, int16_t right, int16_t bottom);
+
+/*
+    Draw only the segment ending at the most recently added vertex, so a
+  path can be shown while it is still arriving.  Returns 1 if any of the
+  segment was visible in the display window.
+*/
+uint8_t draw_path_last_segment();
+
+/*
+    The vertices of the path as they are packed in the arena, for saving
+  the path elsewhere.  Returns the packed bytes and sets *len to how many
+  there are.
+*/
+const uint8_t *path_packed(uint16_t *len);
+
+/*
+    Replace the path by one saved from path_packed, in two steps: get the
+  buffer to copy the len packed bytes into with path_load_start, which
+  returns 0 if they do not fit, and then call path_load_finish with the
+  number of vertices they hold.
+*/
+uint8_t *path_load_start(uint16_t len);
+void path_load_finish(uint16_t num_vertices);
+
+#endif
@@ -0,0 +1,60 @@
+#include <Arduino.h>
+#include <mem_syms.h>
+
+#include "profile.h"
+
+/*
+    Module to count where the client spends its time.  The counters are
+    plain sums kept in RAM so that recording a run costs two calls to
+    micros() and a few additions, and they are only formatted, as a
+    compact binary record, when the host asks for them.
+*/
+
+const uint8_t prof_record_version = 1;
+
+prof_counter_t prof_counters[prof_num_counters];
+
+uint16_t prof_min_free_mem = 0xFFFF;
+
+void prof_record(uint8_t counter, uint32_t start_us) {
+    uint32_t elapsed = micros() - start_us;
+    prof_counter_t *c = &prof_counters[counter];
+
+    if ( c->count == 0 || elapsed < c->min_us ) {
+        c->min_us = elapsed;
+        }
+    if ( elapsed > c->max_us ) {
+        c->max_us = elapsed;
+        }
+    c->total_us += elapsed;
+    c->count++;
+    }
+
+void prof_sample_memory() {
+    uint16_t free_mem = AVAIL_MEM;
+    if ( free_mem < prof_min_free_mem ) {
+        prof_min_free_mem = free_mem;
+        }
+    }
+
+// write n bytes of data, adding them to the checksum
+void prof_write(const void *data, uint8_t n, uint8_t *checksum) {
+    const uint8_t *bytes = (const uint8_t *) data;
+    for (uint8_t i = 0; i < n; i++) {
+        *checksum += bytes[i];
+        }
+    Serial.write(bytes, n);
+    }
+
+void prof_dump() {
+    uint8_t checksum = 0;
+    uint8_t header[4] = { 'P', 'F', prof_record_version, prof_num_counters };
+    uint32_t uptime_ms = millis();
+
+    // the AVR is little-endian, so the values go out in memory order
+    prof_write(header, sizeof(header), &checksum);
+    prof_write(&prof_min_free_mem, sizeof(prof_min_free_mem), &checksum);
+    prof_write(&uptime_ms, sizeof(uptime_ms), &checksum);
+    prof_write(prof_counters, sizeof(prof_counters), &checksum);
+    Serial.write(checksum);
+    }
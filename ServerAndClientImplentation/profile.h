@@ -0,0 +1,60 @@
+/*
+ Lightweight profiling counters for the client.  Each counter keeps the
+ number of times a piece of code ran and the total, minimum and maximum
+ time it took in microseconds, measured with micros().  The lowest free
+ memory seen is kept as well.  The counters are sent to the host as a
+ binary record on request, and decoded by profile_dump.py.
+ */
+
+#ifndef PROFILE_H
+#define PROFILE_H
+
+#include <stdint.h>
+
+// the counters
+const uint8_t prof_loop = 0;          // one pass of loop()
+const uint8_t prof_draw_map = 1;      // draw_map_screen
+const uint8_t prof_draw_path = 2;     // draw_path
+const uint8_t prof_erase_cursor = 3;  // erase_cursor
+const uint8_t prof_route_rx = 4;      // receiving and storing path data
+const uint8_t prof_route_cache = 5;   // looking up and saving cached routes
+const uint8_t prof_num_counters = 6;
+
+typedef struct {
+    uint32_t count;
+    uint32_t total_us;
+    uint32_t min_us;
+    uint32_t max_us;
+} prof_counter_t;
+
+/*
+    Add one run of counter that started at start_us, a value of micros(),
+  and ends now.
+*/
+void prof_record(uint8_t counter, uint32_t start_us);
+
+/*
+    Check the free memory and lower the low-water mark if it is less.
+*/
+void prof_sample_memory();
+
+/*
+    Write the counters to the serial port as one binary record, laid out
+  little-endian as:
+      'P' 'F'                 magic
+      uint8_t version         prof_record_version
+      uint8_t num_counters
+      uint16_t min_free_mem   lowest free memory seen, in bytes
+      uint32_t uptime_ms      millis() when the record was made
+      prof_counter_t          for each counter, 4 uint32_t
+      uint8_t checksum        sum of all the bytes before it
+  The counters are not reset, so the host works out rates from the
+  difference between records.  total_us wraps after 2^32 us, about 71.6
+  minutes, and uptime_ms after about 49.7 days, so differences are taken
+  modulo 2^32 and records must be read more often than total_us wraps.
+*/
+void prof_dump();
+
+extern const uint8_t prof_record_version;
+
+#endif
@@ -0,0 +1,211 @@
+"""
+Host tool to read the profiling counters from the Arduino client.
+
+Sends "P" to the client every few seconds, decodes the binary
+records it answers with (see profile.h) and prints, for each
+counter, the runs and time spent since the previous record along
+with the running totals, minimum and maximum, and the lowest free
+memory seen.  Records can also be read back from a file saved with
+--save.
+
+Usage:
+    python3 profile_dump.py [port] [--interval secs] [--save file]
+    python3 profile_dump.py --file file
+
+The route server must not be using the port at the same time.
+"""
+import struct
+import sys
+import time
+
+RECORD_VERSION = 1
+COUNTER_NAMES = ["loop", "draw_map", "draw_path", "erase_cursor",
+                 "route_rx", "route_cache"]
+
+HEADER = struct.Struct("<2sBBHI")
+COUNTER = struct.Struct("<IIII")
+
+class RecordReader:
+    """
+    Reads records using read(n), which returns up to n bytes,
+    skipping anything before the magic. Bytes read past the end
+    of one record are kept for the next, so records that arrive
+    together are each decoded.
+
+    >>> def record(uptime_ms):
+    ...     body = struct.pack("<2sBBHI", b"PF", 1, 1, 900, uptime_ms)
+    ...     body += struct.pack("<IIII", 2, 30, 10, 20)
+    ...     return body + bytes([sum(body) % 256])
+    >>> data = iter([b"xx" + record(5000) + record(6000)])
+    >>> reader = RecordReader(lambda n: next(data, b""))
+    >>> first = reader.read_record()
+    >>> first["min_free_mem"], first["counters"]["loop"]
+    (900, (2, 30, 10, 20))
+    >>> reader.read_record()["uptime_ms"]
+    6000
+    >>> reader.read_record() is None
+    True
+    """
+    def __init__(self, read):
+        self._read = read
+        self._buffer = b""
+
+    def _fill(self, size):
+        """
+        Read until at least size bytes are buffered. Returns
+        False if the input ends first.
+        """
+        while len(self._buffer) < size:
+            chunk = self._read(size - len(self._buffer))
+            if not chunk:
+                return False
+            self._buffer += chunk
+        return True
+
+    def read_record(self):
+        """
+        Read the next record. Returns it decoded as a dictionary,
+        or None at the end of the input.
+        """
+        while True:
+            start = self._buffer.find(b"PF")
+            if start < 0:
+                # the last byte may be the start of the magic
+                self._buffer = self._buffer[-1:]
+                if not self._fill(HEADER.size):
+                    return None
+                continue
+            self._buffer = self._buffer[start:]
+            if not self._fill(HEADER.size):
+                return None
+
+            magic, version, num_counters, min_free_mem, uptime_ms = \
+                HEADER.unpack_from(self._buffer)
+            if version != RECORD_VERSION:
+                # not a record after all, look for the next magic
+                self._buffer = self._buffer[2:]
+                continue
+            size = HEADER.size + num_counters * COUNTER.size + 1
+            if not self._fill(size):
+                return None
+
+            raw = self._buffer[:size]
+            if sum(raw[:-1]) % 256 != raw[-1]:
+                # not a record after all, look for the next magic
+                self._buffer = self._buffer[2:]
+                continue
+            self._buffer = self._buffer[size:]
+
+            counters = {}
+            for i in range(num_counters):
+                name = COUNTER_NAMES[i] if i < len(COUNTER_NAMES) else str(i)
+                counters[name] = COUNTER.unpack_from(raw, HEADER.size + i * COUNTER.size)
+
+            return {"uptime_ms": uptime_ms, "min_free_mem": min_free_mem,
+                    "counters": counters, "raw": raw}
+
+def wrapped_delta(now, before):
+    """
+    The increase of a uint32_t counter from before to now,
+    allowing for it having wrapped past 2**32 in between.
+
+    >>> wrapped_delta(500, 200)
+    300
+    >>> wrapped_delta(100, 2**32 - 50)
+    150
+    """
+    return (now - before) % (1 << 32)
+
+def unwrap(record, previous):
+    """
+    Add to record, as "totals", the total microseconds of each
+    counter without the wrap of the 32 bit total_us, which
+    overflows after about 71.6 minutes. Works as long as records
+    are read more often than that.
+
+    >>> first = {"counters": {"loop": (1, 2**32 - 100, 5, 5)}}
+    >>> unwrap(first, None)
+    >>> second = {"counters": {"loop": (2, 400, 5, 500)}}
+    >>> unwrap(second, first)
+    >>> second["totals"]["loop"] == 2**32 + 400
+    True
+    """
+    totals = {}
+    for name, (count, total, low, high) in record["counters"].items():
+        if previous is None or name not in previous["totals"]:
+            totals[name] = total
+        else:
+            totals[name] = previous["totals"][name] + \
+                wrapped_delta(total, previous["counters"][name][1])
+    record["totals"] = totals
+
+def report(record, previous):
+    """
+    Print the counters of record, with the change since previous.
+    """
+    unwrap(record, previous)
+    sys.stdout.write("uptime %.1f s  min free mem %d bytes\n" %
+                     (record["uptime_ms"] / 1000.0, record["min_free_mem"]))
+    sys.stdout.write("%-13s %8s %10s %8s %8s %8s %8s\n" %
+                     ("counter", "runs", "total ms", "mean us", "min us",
+                      "max us", "recent%"))
+
+    elapsed_us = 0
+    if previous is not None:
+        elapsed_us = wrapped_delta(record["uptime_ms"],
+                                   previous["uptime_ms"]) * 1000
+
+    for name, (count, total, low, high) in record["counters"].items():
+        total = record["totals"][name]
+        mean = total / count if count else 0
+        share = ""
+        if previous is not None and elapsed_us > 0:
+            recent = total - previous["totals"][name]
+            share = "%.1f" % (100.0 * recent / elapsed_us)
+        sys.stdout.write("%-13s %8d %10.1f %8.0f %8d %8d %8s\n" %
+                         (name, count, total / 1000.0, mean, low, high, share))
+    sys.stdout.write("\n")
+
+def main(argv):
+    port = "/dev/ttyACM0"
+    interval = 5.0
+    save = None
+    replay = None
+
+    args = iter(argv)
+    for arg in args:
+        if arg == "--interval":
+            interval = float(next(args))
+        elif arg == "--save":
+            save = open(next(args), "ab")
+        elif arg == "--file":
+            replay = open(next(args), "rb")
+        else:
+            port = arg
+
+    previous = None
+    if replay is not None:
+        reader = RecordReader(replay.read)
+        while True:
+            record = reader.read_record()
+            if record is None:
+                return
+            report(record, previous)
+            previous = record
+
+    import serial
+    ser = serial.Serial(port, 9600, timeout=2)
+    reader = RecordReader(ser.read)
+    while True:
+        ser.write(b"P\n")
+        record = reader.read_record()
+        if record is not None:
+            if save is not None:
+                save.write(record["raw"])
+                save.flush()
+            report(record, previous)
+            previous = record
+        time.sleep(interval)
+
+if __name__ == "__main__":
+    main(sys.argv[1:])
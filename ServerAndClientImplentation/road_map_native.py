@@ -0,0 +1,186 @@
+"""
+Python side of the native road map loader in ../RouteEngine.
+
+load_road_map_native parses the road network text file with
+libroadmap.so and returns the same graph, location and streetnames
+as load_edmonton_road_map in server.py, or None if the library has
+not been built, so the caller can fall back to parsing in Python.
+
+open_cell_graph maps a cell graph written by RouteEngine/cell_build,
+which answers nearest vertex and route queries without the map ever
+being loaded into Python.
+
+The library is looked for in ../RouteEngine, or at the path in the
+ROUTE_ENGINE_LIB environment variable.
+"""
+import ctypes
+import os
+
+from graph import Graph
+
+_lib = None
+
+def _load_library():
+    """
+    Load libroadmap.so once and declare the functions used,
+    returning None if it cannot be found.
+    """
+    global _lib
+    if _lib is not None:
+        return _lib
+
+    path = os.environ.get("ROUTE_ENGINE_LIB",
+                          os.path.join(os.path.dirname(os.path.abspath(__file__)),
+                                       "..", "RouteEngine", "libroadmap.so"))
+    try:
+        lib = ctypes.CDLL(path)
+    except OSError:
+        return None
+
+    lib.road_map_load.restype = ctypes.c_void_p
+    lib.road_map_load.argtypes = [ctypes.c_char_p, ctypes.c_uint]
+    lib.road_map_last_error.restype = ctypes.c_char_p
+    lib.road_map_free.argtypes = [ctypes.c_void_p]
+    for name in ("road_map_num_vertices", "road_map_num_edges",
+                 "road_map_names_size"):
+        getattr(lib, name).restype = ctypes.c_uint32
+        getattr(lib, name).argtypes = [ctypes.c_void_p]
+    lib.road_map_vertices.argtypes = [ctypes.c_void_p, ctypes.c_void_p,
+                                      ctypes.c_void_p, ctypes.c_void_p]
+    lib.road_map_csr.argtypes = [ctypes.c_void_p, ctypes.c_void_p,
+                                 ctypes.c_void_p]
+    lib.road_map_edges.argtypes = [ctypes.c_void_p, ctypes.c_void_p,
+                                   ctypes.c_void_p]
+    lib.road_map_names.argtypes = [ctypes.c_void_p, ctypes.c_void_p,
+                                   ctypes.c_void_p]
+
+    lib.cell_graph_open.restype = ctypes.c_void_p
+    lib.cell_graph_open.argtypes = [ctypes.c_char_p]
+    lib.cell_graph_close.argtypes = [ctypes.c_void_p]
+    lib.cell_graph_nearest.restype = ctypes.c_uint32
+    lib.cell_graph_nearest.argtypes = [ctypes.c_void_p, ctypes.c_int32,
+                                       ctypes.c_int32]
+    lib.cell_graph_location.argtypes = [ctypes.c_void_p, ctypes.c_uint32,
+                                        ctypes.c_void_p, ctypes.c_void_p]
+    lib.cell_graph_route.restype = ctypes.c_uint32
+    lib.cell_graph_route.argtypes = [ctypes.c_void_p, ctypes.c_uint32,
+                                     ctypes.c_uint32, ctypes.c_void_p,
+                                     ctypes.c_uint32]
+
+    _lib = lib
+    return _lib
+
+def load_road_map_native(filename, threads=0):
+    """
+    Read the road map in filename with the native loader.
+    Returns (graph, location, streetnames), or None if the
+    native library is not available. Raises IOError if the
+    file cannot be read.
+    """
+    lib = _load_library()
+    if lib is None:
+        return None
+
+    handle = lib.road_map_load(filename.encode(), threads)
+    if not handle:
+        raise IOError(lib.road_map_last_error().decode())
+
+    try:
+        n = lib.road_map_num_vertices(handle)
+        m = lib.road_map_num_edges(handle)
+
+        ids = (ctypes.c_int64 * n)()
+        lat = (ctypes.c_int32 * n)()
+        lon = (ctypes.c_int32 * n)()
+        lib.road_map_vertices(handle, ids, lat, lon)
+
+        first_out = (ctypes.c_uint32 * (n + 1))()
+        head = (ctypes.c_uint32 * m)()
+        lib.road_map_csr(handle, first_out, head)
+
+        edge_from = (ctypes.c_uint32 * m)()
+        edge_to = (ctypes.c_uint32 * m)()
+        lib.road_map_edges(handle, edge_from, edge_to)
+
+        names = ctypes.create_string_buffer(lib.road_map_names_size(handle))
+        name_offset = (ctypes.c_uint32 * (m + 1))()
+        lib.road_map_names(handle, names, name_offset)
+    finally:
+        lib.road_map_free(handle)
+
+    ids = list(ids)
+    first_out = list(first_out)
+    head = list(head)
+    names = names.raw.decode('utf-8', 'replace')
+
+    # Build the adjacency lists in one go, the neighbours of each
+    # vertex are already in file order
+    graph = Graph.from_adjacency(
+        {ids[u]: [ids[v] for v in head[first_out[u]:first_out[u+1]]]
+         for u in range(n)})
+
+    location = dict(zip(ids, zip(lat, lon)))
+
+    streetnames = {}
+    for i, (u, v) in enumerate(zip(edge_from, edge_to)):
+        streetnames[(ids[u], ids[v])] = names[name_offset[i]:name_offset[i+1]]
+
+    return graph, location, streetnames
+
+class CellGraph:
+    """
+    A cell graph file mapped by the native library. Vertices are
+    the numbers the cell graph gives them, which are only meaningful
+    to the same CellGraph.
+    """
+    def __init__(self, lib, handle):
+        self._lib = lib
+        self._handle = handle
+
+    def close(self):
+        if self._handle:
+            self._lib.cell_graph_close(self._handle)
+            self._handle = None
+
+    def nearest(self, lat, lon):
+        """The vertex closest to a fixed point position."""
+        return self._lib.cell_graph_nearest(self._handle, lat, lon)
+
+    def location(self, v):
+        """The fixed point (lat, lon) of vertex v."""
+        lat = ctypes.c_int32()
+        lon = ctypes.c_int32()
+        self._lib.cell_graph_location(self._handle, v, ctypes.byref(lat),
+                                      ctypes.byref(lon))
+        return (lat.value, lon.value)
+
+    def route(self, start, dest):
+        """
+        The vertices of a least cost path from start to dest, or
+        [] if there is none, as least_cost_path in server.py.
+        Several threads may route at once; the search runs
+        without the GIL.
+        """
+        path = (ctypes.c_uint32 * 1024)()
+        n = self._lib.cell_graph_route(self._handle, start, dest,
+                                       path, len(path))
+        if n > len(path):
+            path = (ctypes.c_uint32 * n)()
+            n = self._lib.cell_graph_route(self._handle, start, dest, path, n)
+        return list(path[:n])
+
+def open_cell_graph(filename):
+    """
+    Map the cell graph in filename. Returns None if the native
+    library is not available or there is no such file. Raises
+    IOError if the file is not a cell graph.
+    """
+    lib = _load_library()
+    if lib is None or not os.path.exists(filename):
+        return None
+
+    handle = lib.cell_graph_open(filename.encode())
+    if not handle:
+        raise IOError(lib.road_map_last_error().decode())
+    return CellGraph(lib, handle)
+
@@ -0,0 +1,208 @@
+#include <Arduino.h>
+#include <stdio.h>
+#include <SD.h>
+
+#include "path.h"
+#include "route_cache.h"
+
+/*
+    Module to keep recently received routes on the SD card.
+
+    Each route is saved in a file of its own, ROUTEn.DAT for slot n, as
+    the packed bytes of the path arena, so loading one is a single read
+    straight into the arena with nothing to decode.  The index file,
+    ROUTEIDX.DAT, has one entry per slot with the key of the route in it,
+    its size and when it was last used.  The index is scanned on the card
+    rather than kept in RAM, which is too short to spare for it, and at
+    a few hundred bytes the scan is one or two blocks.
+
+    The index is opened O_READ | O_WRITE rather than FILE_WRITE, which
+    adds O_APPEND and so sends every write to the end of the file
+    wherever it was seeked to; entries have to be written in place.
+
+    Use is counted with a number that goes up on every load and store;
+    the slot with the lowest count is the least recently used and is the
+    one a new route replaces.  A count of 0 marks an empty slot.
+*/
+
+// points closer than 2^route_cache_shift, in the units of lat and lon,
+// fall into the same key
+const uint8_t route_cache_shift = 5;
+
+const uint8_t route_cache_slots = 16;
+
+// the size of the path arena, and so the most a route can pack into
+const uint16_t route_cache_max_len = 2048;
+
+const char route_cache_index[] = "ROUTEIDX.DAT";
+
+typedef struct {
+    route_key_t key;
+    uint32_t last_used;     // use count, 0 if the slot is empty
+    uint16_t num_vertices;
+    uint16_t len;           // packed bytes in the route file
+} route_cache_entry_t;
+
+void route_cache_key(route_key_t *key, int32_t start_lat, int32_t start_lon,
+    int32_t stop_lat, int32_t stop_lon) {
+    key->start_lat = start_lat >> route_cache_shift;
+    key->start_lon = start_lon >> route_cache_shift;
+    key->stop_lat = stop_lat >> route_cache_shift;
+    key->stop_lon = stop_lon >> route_cache_shift;
+    }
+
+// the name of the file of slot, in name which holds at least 13 chars
+void route_cache_file_name(char *name, uint8_t slot) {
+    snprintf(name, 13, "ROUTE%u.DAT", slot);
+    }
+
+void route_cache_init() {
+    File index = SD.open(route_cache_index, FILE_READ);
+    if ( index ) {
+        uint32_t size = index.size();
+        index.close();
+        if ( size == route_cache_slots * sizeof(route_cache_entry_t) ) {
+            return;
+            }
+        // from a build with a different number of slots
+        SD.remove(route_cache_index);
+        }
+
+    route_cache_entry_t entry;
+    memset(&entry, 0, sizeof(entry));
+    index = SD.open(route_cache_index, O_READ | O_WRITE | O_CREAT);
+    if ( !index ) {
+        return;
+        }
+    for (uint8_t slot = 0; slot < route_cache_slots; slot++) {
+        index.write((const uint8_t *) &entry, sizeof(entry));
+        }
+    index.close();
+    }
+
+/*
+    Scan the index for key.  Sets *found to its slot, or route_cache_slots
+  if it is not cached, *oldest to the least recently used slot, and
+  *last_used to the highest use count.  Returns the entry of the key,
+  which is only meaningful if it was found.
+*/
+route_cache_entry_t route_cache_find(File &index, const route_key_t *key,
+    uint8_t *found, uint8_t *oldest, uint32_t *last_used) {
+    route_cache_entry_t entry;
+    route_cache_entry_t match;
+    uint32_t oldest_used = 0xFFFFFFFF;
+    memset(&match, 0, sizeof(match));
+
+    *found = route_cache_slots;
+    *oldest = 0;
+    *last_used = 0;
+    for (uint8_t slot = 0; slot < route_cache_slots; slot++) {
+        if ( index.read(&entry, sizeof(entry)) != sizeof(entry) ) {
+            break;
+            }
+        if ( entry.last_used != 0 &&
+             memcmp(&entry.key, key, sizeof(route_key_t)) == 0 ) {
+            *found = slot;
+            match = entry;
+            }
+        if ( entry.last_used < oldest_used ) {
+            oldest_used = entry.last_used;
+            *oldest = slot;
+            }
+        if ( entry.last_used > *last_used ) {
+            *last_used = entry.last_used;
+            }
+        }
+    return match;
+    }
+
+// write entry as the index entry of slot
+void route_cache_put_entry(File &index, uint8_t slot,
+    const route_cache_entry_t *entry) {
+    index.seek(slot * sizeof(route_cache_entry_t));
+    index.write((const uint8_t *) entry, sizeof(route_cache_entry_t));
+    }
+
+uint8_t route_cache_load(const route_key_t *key) {
+    File index = SD.open(route_cache_index, O_READ | O_WRITE);
+    if ( !index ) {
+        return 0;
+        }
+    index.seek(0);
+
+    uint8_t slot;
+    uint8_t oldest;
+    uint32_t last_used;
+    route_cache_entry_t entry =
+        route_cache_find(index, key, &slot, &oldest, &last_used);
+
+    uint8_t loaded = 0;
+    if ( slot < route_cache_slots ) {
+        char name[13];
+        route_cache_file_name(name, slot);
+        File file = SD.open(name, FILE_READ);
+        uint8_t *packed = path_load_start(entry.len);
+        if ( file && packed && file.read(packed, entry.len) == entry.len ) {
+            path_load_finish(entry.num_vertices);
+            loaded = 1;
+
+            entry.last_used = last_used + 1;
+            route_cache_put_entry(index, slot, &entry);
+            }
+        else {
+            path_clear();
+            }
+        if ( file ) {
+            file.close();
+            }
+        }
+
+    index.close();
+    return loaded;
+    }
+
+void route_cache_store(const route_key_t *key) {
+    uint16_t len;
+    const uint8_t *packed = path_packed(&len);
+    if ( path_num_vertices == 0 || len > route_cache_max_len ) {
+        return;
+        }
+
+    File index = SD.open(route_cache_index, O_READ | O_WRITE);
+    if ( !index ) {
+        return;
+        }
+    index.seek(0);
+
+    uint8_t slot;
+    uint8_t oldest;
+    uint32_t last_used;
+    route_cache_find(index, key, &slot, &oldest, &last_used);
+    if ( slot == route_cache_slots ) {
+        slot = oldest;
+        }
+
+    // Empty the slot while its file is rewritten, so a reset part way
+    // through leaves no entry pointing at half a route.
+    route_cache_entry_t entry;
+    memset(&entry, 0, sizeof(entry));
+    route_cache_put_entry(index, slot, &entry);
+
+    char name[13];
+    route_cache_file_name(name, slot);
+    SD.remove(name);
+    File file = SD.open(name, FILE_WRITE);
+    if ( file ) {
+        uint16_t written = file.write(packed, len);
+        file.close();
+        if ( written == len ) {
+            entry.key = *key;
+            entry.last_used = last_used + 1;
+            entry.num_vertices = path_num_vertices;
+            entry.len = len;
+            route_cache_put_entry(index, slot, &entry);
+            }
+        }
+
+    index.close();
+    }
@@ -0,0 +1,48 @@
+/*
+ Cache of recently received routes on the SD card, so a route asked for
+ again is drawn from the card instead of being fetched over the serial
+ link.  Routes are looked up by their start and stop points, quantized so
+ that picking nearly the same points again finds the same route.
+ */
+
+#ifndef ROUTE_CACHE_H
+#define ROUTE_CACHE_H
+
+#include <stdint.h>
+
+// the start and stop points of a route, quantized
+typedef struct {
+    int32_t start_lat;
+    int32_t start_lon;
+    int32_t stop_lat;
+    int32_t stop_lon;
+} route_key_t;
+
+/*
+    Make the key of the route from (start_lat, start_lon) to
+  (stop_lat, stop_lon).
+*/
+void route_cache_key(route_key_t *key, int32_t start_lat, int32_t start_lon,
+    int32_t stop_lat, int32_t stop_lon);
+
+/*
+    Open the cache on the SD card, creating an empty one if there is none.
+  Call once after the SD card has been initialized.
+*/
+void route_cache_init();
+
+/*
+    Look for the route with key.  If it is cached it replaces the current
+  path and 1 is returned.  Otherwise 0 is returned, and the path is left
+  alone unless the route was in the index but could not be read, which
+  clears it.
+*/
+uint8_t route_cache_load(const route_key_t *key);
+
+/*
+    Save the current path as the route with key, in place of the least
+  recently used route if the cache is full.
+*/
+void route_cache_store(const route_key_t *key);
+
+#endif
@@ -84,3 +84,88 @@ int32_t string_get_int(const char *str) {
 
     return val;
 }
+
+uint8_t serial_poll_line(serial_line_t *rx) {
+    while (Serial.available() > 0) {
+        char c = (char) Serial.read();
+
+        // A newline is given by \r or \n, or some combination of both
+        if ( c == '\r' || c == '\n' ) {
+            if ( rx->len == 0 ) {
+                // nothing on this line, so keep going
+                continue;
+                }
+            rx->line[rx->len] = '\0';
+            rx->len = 0;
+            return 1;
+            }
+
+        // keep room for the null terminator, drop the rest of a long line
+        if ( rx->len < serial_line_size - 1 ) {
+            rx->line[rx->len] = c;
+            rx->len++;
+            }
+        }
+
+    return 0;
+}
+
+void route_rx_init(route_rx_t *route) {
+    route->state = route_rx_header;
+    route->rx.len = 0;
+    route->id = 0;
+    route->num_vertices = 0;
+    route->num_received = 0;
+    route->have_lat = 0;
+}
+
+uint8_t route_rx_poll(route_rx_t *route) {
+    if ( route->state == route_rx_header ) {
+        if ( !serial_poll_line(&route->rx) ) {
+            return route_rx_none;
+            }
+
+        if ( route->rx.line[0] != 'N' ) {
+            // not a route, leave it for the caller
+            return route_rx_line;
+            }
+
+        // "N <id> <count>"
+        char field[8];
+        uint16_t pos = string_read_field(route->rx.line, 2, field,
+            sizeof(field), " ");
+        route->id = string_get_int(field);
+        string_read_field(route->rx.line, pos, field, sizeof(field), " ");
+        route->num_vertices = string_get_int(field);
+        route->num_received = 0;
+        route->have_lat = 0;
+        route->state = route_rx_vertices;
+        return route_rx_got_count;
+        }
+
+    // an empty route is finished as soon as its count is known
+    while ( route->num_received < route->num_vertices ) {
+        if ( !serial_poll_line(&route->rx) ) {
+            return route_rx_none;
+            }
+
+        if ( route->rx.line[0] == '!' ) {
+            // the server has cut the route short
+            break;
+            }
+
+        if ( !route->have_lat ) {
+            route->lat = string_get_int(route->rx.line);
+            route->have_lat = 1;
+            continue;
+            }
+
+        route->lon = string_get_int(route->rx.line);
+        route->have_lat = 0;
+        route->num_received++;
+        return route_rx_got_vertex;
+        }
+
+    route->state = route_rx_header;
+    return route_rx_done;
+}
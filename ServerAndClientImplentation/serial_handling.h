@@ -66,4 +66,91 @@ uint16_t string_read_field(const char *str, uint16_t str_start,
 
 int32_t string_get_int(const char *str);
 
+/*
+    A line being assembled from the serial port a few bytes at a time.
+  Initialize len to 0 before the first call to serial_poll_line.
+*/
+const uint8_t serial_line_size = 16;
+
+typedef struct {
+    char line[serial_line_size];
+    uint8_t len;
+} serial_line_t;
+
+/*
+    Non-blocking counterpart of serial_readline.  Moves whatever bytes are
+  waiting on the serial port into rx, stopping at the end of a line.
+
+  Arguments:
+  rx: The partial line, which is carried over between calls.
+
+  Preconditions:  None.
+
+  Postconditions: If a non-empty line was completed it is null terminated
+    in rx->line, and rx->len is reset so the next call starts a new line.
+    Characters past the size of rx->line are dropped.  Empty lines, such as
+    the second half of a CRLF, are skipped.
+
+  Returns: 1 if a complete line is in rx->line, and 0 otherwise.
+*/
+uint8_t serial_poll_line(serial_line_t *rx);
+
+/*
+    Incremental receiver for routes sent by the server.  Each route is
+  answered to a request "R <id> <lat1> <lon1> <lat2> <lon2>" and starts
+  with the line "N <id> <count>", followed by the lat and the lon of each
+  vertex, each on its own line.  Several requests can be outstanding and
+  their routes arrive one after another, in the order they were asked
+  for; a request cancelled with "X <id>" before its route starts is never
+  answered, and one cancelled while its route is being sent, or because
+  the client ran out of room for it, is ended early by a "!" line.
+  route_rx_poll is called on every pass of loop() and never waits for
+  the serial port, so the user interface keeps running while routes
+  arrive.
+*/
+
+// receiver states
+const uint8_t route_rx_header = 0;    // waiting for the next route
+const uint8_t route_rx_vertices = 1;  // waiting for the vertices of a route
+
+// events returned by route_rx_poll
+const uint8_t route_rx_none = 0;      // nothing new, call again later
+const uint8_t route_rx_got_count = 1; // id and num_vertices are known
+const uint8_t route_rx_got_vertex = 2;// lat and lon hold the next vertex
+const uint8_t route_rx_done = 3;      // the route has ended
+const uint8_t route_rx_line = 4;      // a line that is not part of a route
+                                      // is in rx.line
+
+typedef struct {
+    uint8_t state;
+    serial_line_t rx;
+
+    uint16_t id;              // request id of the route being received
+    uint16_t num_vertices;    // number of vertices announced by the server
+    uint16_t num_received;    // number of complete vertices so far
+    uint8_t have_lat;         // the lat of the next vertex has been read
+
+    int32_t lat;              // the vertex most recently received
+    int32_t lon;
+} route_rx_t;
+
+/*
+    Get ready to receive routes.  Call once before the first request.
+*/
+void route_rx_init(route_rx_t *route);
+
+/*
+    Parse whatever route data is waiting on the serial port, stopping as
+  soon as a line completes something the caller has to act on.  Keep
+  calling until route_rx_none is returned to consume all the waiting data.
+
+  Returns: one of the route_rx_ events above.  After route_rx_got_vertex
+    the vertex is in route->lat and route->lon and is vertex number
+    route->num_received - 1.  After route_rx_done the receiver waits for
+    the next route, and num_received is less than num_vertices if the
+    route was ended early.  After route_rx_line the line, such as a
+    command from the host, is in route->rx.line.
+*/
+uint8_t route_rx_poll(route_rx_t *route);
+
 #endif
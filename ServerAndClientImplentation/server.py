@@ -1,11 +1,11 @@
 from graph import Graph
+from road_map_native import load_road_map_native, open_cell_graph
+from event_server import EventServer
+import functools
+import metrics
 import sys
-import serial
-import time
 # Some little helper functions to help ease readability
 
-ser = serial.Serial('/dev/ttyACM0', 9600)
-
 def reconstruct_path(start, dest, parents):
     """
     reconstruct_path reconstructs the shortest path from vertex
@@ -43,16 +43,38 @@ def process_coord(coord):
     longitude coordinate convert it be in
     100, 1000ths of a degree. Truncate to be an
     int.
+
+    The digits are truncated to five decimal places as
+    they are written rather than through a float, which
+    can land just under the value, and so agree with
+    parse_fixed_coord in the native loader.
+
+    >>> process_coord("53.430996")
+    5343099
+    >>> process_coord("-113.491331")
+    -11349133
+    >>> process_coord("0.29") # int(float("0.29")*100000) is 28999
+    29000
+    >>> process_coord("53")
+    5300000
     """
-    return int(float(coord)*100000)
+    coord = coord.strip()
+    negative = coord.startswith("-")
+    whole, _, fraction = coord.lstrip("+-").partition(".")
+    value = int(whole or "0")*100000 + int((fraction + "00000")[:5])
+    return -value if negative else value
 
-def least_cost_path(graph, start, dest, cost):
+def least_cost_path(graph, start, dest, cost, stats=None):
     """
     Using Dijkstra's algorithm to solve for the least
     cost path in graph from start vertex to dest vertex.
     Input variable cost is a function with method signature
     c = cost(e) where e is an edge from graph.
 
+    If a dictionary stats is given, the number of vertices
+    settled and the largest size of the todo set are stored
+    in it as "settled" and "max_todo".
+
     >>> graph = Graph({1,2,3,4,5,6}, [(1,2), (1,3), (1,6), (2,1), (2,3), (2,4), (3,1), (3,2), \
             (3,4), (3,6), (4,2), (4,3), (4,5), (5,4), (5,6), (6,1), (6,3), (6,5)])
     >>> weights = {(1,2): 7, (1,3):9, (1,6):14, (2,1):7, (2,3):10, (2,4):15, (3,1):9, \
@@ -61,6 +83,11 @@ def least_cost_path(graph, start, dest, cost):
     >>> cost = lambda e: weights.get(e, float("inf"))
     >>> least_cost_path(graph, 1,5, cost)
     [1, 3, 6, 5]
+    >>> stats = {}
+    >>> least_cost_path(graph, 1,5, cost, stats)
+    [1, 3, 6, 5]
+    >>> stats["settled"], stats["max_todo"]
+    (5, 3)
     """
     # est_min_cost[v] is our estimate of the lowest cost
     # from vertex start to vertex v
@@ -77,13 +104,20 @@ def least_cost_path(graph, start, dest, cost):
 
     est_min_cost[start] = 0
 
+    settled = 0
+    max_todo = 1
+
     while todo:
         current = min(todo, key=lambda x: est_min_cost[x])
 
         if current == dest:
+            if stats is not None:
+                stats["settled"] = settled
+                stats["max_todo"] = max_todo
             return reconstruct_path(start, dest, parents)
 
         todo.remove(current)
+        settled += 1
 
         for neighbour in graph.neighbours(current):
             #if neighbour isn't in est_min_cost, that means I haven't seen it before,
@@ -91,6 +125,7 @@ def least_cost_path(graph, start, dest, cost):
             #estimated cost and set it's parent
             if not neighbour in est_min_cost:
                 todo.add(neighbour)
+                max_todo = max(max_todo, len(todo))
                 est_min_cost[neighbour] = (est_min_cost[current] + cost((current, neighbour)))
                 parents[neighbour] = current
             elif est_min_cost[neighbour] > (est_min_cost[current] + cost((current, neighbour))):
@@ -100,6 +135,9 @@ def least_cost_path(graph, start, dest, cost):
                 est_min_cost[neighbour] = (est_min_cost[current] + cost((current, neighbour)))
                 parents[neighbour] = current
 
+    if stats is not None:
+        stats["settled"] = settled
+        stats["max_todo"] = max_todo
     return []
 
 def load_edmonton_road_map(filename):
@@ -109,6 +147,43 @@ def load_edmonton_road_map(filename):
     for looking up the latitude and longitude information
     for vertices and a dictionary for mapping streetnames
     to their associated edges.
+
+    The file is parsed by the native loader in RouteEngine
+    when it has been built, and in Python otherwise. Both
+    read the same map, which the test below checks on a
+    file with the awkward cases in it.
+
+    >>> import os, tempfile
+    >>> with tempfile.NamedTemporaryFile('w', suffix='.txt', delete=False) as f:
+    ...     _ = f.write("V,1,53.29,-113.29\\n"
+    ...                 "E,1,2,Before Its Vertex\\n"
+    ...                 "V,2,53.5000099,-113.5\\r\\n"
+    ...                 "V,1,53.31,-113.31\\n"
+    ...                 "E,1,2,Main Street, North\\n"
+    ...                 "E,2,3,Nowhere\\n"
+    ...                 "E,2,1,Back Lane\\n")
+    >>> python = read_road_map_python(f.name)
+    >>> python[0].edges(), python[1], python[2]
+    ([(1, 2), (2, 1)], {1: (5331000, -11331000), 2: (5350000, -11350000)}, {(1, 2): 'Main Street, North', (2, 1): 'Back Lane'})
+    >>> native = load_road_map_native(f.name)
+    >>> native is None or ((native[0].edges(), native[1], native[2]) ==
+    ...                        (python[0].edges(), python[1], python[2]))
+    True
+    >>> os.remove(f.name)
+    """
+    native = load_road_map_native(filename)
+    if native is not None:
+        return native
+    return read_road_map_python(filename)
+
+def read_road_map_python(filename):
+    """
+    Parse the road map in filename in Python, for when the
+    native loader has not been built. As Graph.add_edge
+    has it, an edge is dropped unless both its vertices
+    are on earlier lines, and a vertex given twice keeps
+    its last location. The street name is the rest of the
+    line, commas and all.
     """
     graph = Graph()
     location = {}
@@ -116,81 +191,126 @@ def load_edmonton_road_map(filename):
 
     with open(filename, 'r') as f:
         for line in f:
-            elements = line.split(",")
+            elements = line.rstrip("\r\n").split(",", 3)
+            if len(elements) < 4:
+                continue
             if(elements[0] == "V"):
                 graph.add_vertex(int(elements[1]))
                 location[int(elements[1])] = (process_coord(elements[2]),
                                               process_coord(elements[3]))
             elif (elements[0] == "E"):
-                graph.add_edge((int(elements[1]), int(elements[2])))
-                streetnames[(int(elements[1]), int(elements[2]))] = elements[3]
+                edge = (int(elements[1]), int(elements[2]))
+                if graph.is_vertex(edge[0]) and graph.is_vertex(edge[1]):
+                    graph.add_edge(edge)
+                    streetnames[edge] = elements[3]
 
     return graph, location, streetnames
 
 
 # Main code that gets run when file is run
-graph, location, streetnames = load_edmonton_road_map("edmonton-roads-2.0.1.txt")
+
+# A cell graph made from the road map by RouteEngine/cell_build is
+# mapped, when there is one, instead of loading the whole map; routes
+# then only read the parts of the map they pass through
+CELL_GRAPH_FILE = "edmonton-roads-2.0.1.cells"
+cells = open_cell_graph(CELL_GRAPH_FILE)
+if cells is None:
+    graph, location, streetnames = load_edmonton_road_map("edmonton-roads-2.0.1.txt")
+    vertex_location = location.__getitem__
+else:
+    vertex_location = cells.location
 
 # Define our cost_distance function that takes in an edge e = (vertexid, vertexid)
 cost_distance = lambda e: straight_line_dist(location[e[0]][0], location[e[0]][1],
                                              location[e[1]][0], location[e[1]][1])
 
-def read_points():
-    while 1:
-        line1 = ser.readline().decode('ASCII')
-        line2 = ser.readline().decode('ASCII')
-        elements1 = line1.split(", ")
-        elements2 = line2.split(", ")
-        lat1 = elements1[-1].rstrip()
-        lat2 = elements2[-1].rstrip()
-        lon1 = elements1[0]
-        lon2 = elements2[0]
-        ard_vert = lat1 + " " + lon1 + " " + lat2 + " " + lon2
-        return ard_vert
-        break
-    
+# Cursor positions are often picked again, so remember the vertex
+# found for the most recent ones instead of scanning every vertex
+@functools.lru_cache(maxsize=256)
+def find_closest_vertex(lat, lon):
+    if cells is not None:
+        return cells.nearest(lat, lon)
+    return min(location, key=lambda v:straight_line_dist(lat, lon, location[v][0], location[v][1]))
 
+def timed_closest_vertex(lat, lon):
+    """
+    find_closest_vertex, recording its time and whether the
+    answer came from the cache.
+    """
+    hits = find_closest_vertex.cache_info().hits
+    with metrics.timed("find_closest_vertex"):
+        v = find_closest_vertex(lat, lon)
+    if find_closest_vertex.cache_info().hits > hits:
+        metrics.count("closest_vertex_cache_hits")
+    else:
+        metrics.count("closest_vertex_cache_misses")
+    return v
+
+def parse_request(line1, line2):
+    """
+    The start and stop points of a request as (lat1, lon1, lat2,
+    lon2), from the two "lon, lat" lines the Arduino sends, or
+    None if they are not numbers.
+
+    >>> parse_request("-11350000, 5350000", "-11340000, 5351000")
+    (5350000, -11350000, 5351000, -11340000)
+    >>> parse_request("-11350000, north", "-11340000, 5351000") is None
+    True
+    """
+    elements1 = line1.split(", ")
+    elements2 = line2.split(", ")
+    try:
+        return (int(elements1[-1]), int(elements1[0]),
+                int(elements2[-1]), int(elements2[0]))
+    except ValueError:
+        return None
+
+def find_route(request):
+    """
+    The least cost path between the points of a request, as the
+    (lat, lon) of each vertex. Runs on the search threads of the
+    event server, several at once.
+    """
+    # Find closest vertices to the provided lat and lon positions
+    start = timed_closest_vertex(request[0], request[1])
+    dest = timed_closest_vertex(request[2], request[3])
+
+    # Find path
+    stats = {}
+    with metrics.timed("least_cost_path"):
+        if cells is not None:
+            path = cells.route(start, dest)
+        else:
+            path = least_cost_path(graph, start, dest, cost_distance, stats)
+    if stats:
+        metrics.observe("settled_nodes", stats["settled"])
+        metrics.observe("queue_depth", stats["max_todo"])
+    metrics.observe("path_vertices", len(path))
+    return [vertex_location(v) for v in path]
+
+
+# Port for the local metrics endpoint, http://127.0.0.1:9100/metrics
+METRICS_PORT = 9100
+
+# Searches that may run at once
+SEARCH_THREADS = 4
 
 if __name__ == "__main__":
-    while(True):
-        user_input = read_points()
-
-        # Exit if the user inputs q, Q, quit, exit, Quit, or Exit
-        if user_input.strip() in {"q", "Q", "quit", "exit", "Quit", "Exit"}:
-            sys.exit()
-
-        # Get lat and lon from stdin. If input is invalid,
-        # restart the while loop (thus allowing the user
-        # to input new coordinates)
-        coords = user_input.split()
-        processed_coords = []
-
-        try:
-            for coord in coords:
-                processed_coords.append(int(coord))
-        except ValueError:
-            sys.stdout.write(str(0)+"\n")
-            continue
-
-        # Find closest vertices to the provided lat and lon positions
-        def find_closest_vertex(lat, lon):
-            return min(location, key=lambda v:straight_line_dist(lat, lon, location[v][0], location[v][1]))
-
-        start = find_closest_vertex(processed_coords[0], processed_coords[1])
-        dest = find_closest_vertex(processed_coords[2], processed_coords[3])
-
-        # Find path
-        path = least_cost_path(graph, start, dest, cost_distance)
-
-        # Send number of edges out to Arduino and Stdout 
-        ser.write((str(len(path)) + "\n").encode('ASCII'))
-        sys.stdout.write(str(len(path)) + "\n")
-        
-        # Send shortest path to Arduino and Stdin
-        for v in path:
-            sys.stdout.write(str(location[v][0]) + " " + \
-                                 str(location[v][1]) + "\n")
-            ser.write((str(location[v][0]) + "\n" + \
-                       str(location[v][1]) + "\n").encode('ASCII'))
-            #To account for buffer speed of Arduino
-            time.sleep(0.1)
+    # Each argument is the serial port of an Arduino, such as a pty
+    # of the route_loadgen load generator, or :port to also take
+    # clients over TCP on that port of the local host
+    links = sys.argv[1:] or ['/dev/ttyACM0']
+
+    try:
+        metrics.start_server(METRICS_PORT)
+    except OSError as e:
+        # another server on this host already has the port
+        sys.stderr.write("metrics endpoint not started: %s\n" % e)
+
+    server = EventServer(find_route, parse_request, SEARCH_THREADS)
+    for link in links:
+        if link.startswith(":"):
+            server.listen(int(link[1:]))
+        else:
+            server.add_serial(link)
+    server.run()